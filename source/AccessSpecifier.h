@@ -25,6 +25,8 @@ public:
 		VERTEX_BUFFER,
 		INDEX_BUFFER,
 		UNIFORM_BUFFER,
+		// reads the pixel being shaded from an attachment written earlier, possibly by a preceding subpass
+		INPUT_ATTACHMENT,
 
 		// write operations
 		COLOR_ATTACHMENT_OUTPUT,
@@ -0,0 +1,74 @@
+#include "BarrierBatch.h"
+
+void BarrierBatch::addMemoryBarrier(VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask, VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask)
+{
+	this->srcStageMask |= srcStageMask;
+	this->dstStageMask |= dstStageMask;
+
+	memoryBarrier.srcAccessMask |= srcAccessMask;
+	memoryBarrier.dstAccessMask |= dstAccessMask;
+	hasMemoryBarrier = true;
+}
+
+void BarrierBatch::addImageBarrier(VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask, const VkImageMemoryBarrier& barrier)
+{
+	this->srcStageMask |= srcStageMask;
+	this->dstStageMask |= dstStageMask;
+
+	imageBarriers.push_back(barrier);
+}
+
+void BarrierBatch::orderAfterSemaphoreWait()
+{
+	srcStageMask = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+	memoryBarrier.srcAccessMask = 0;
+	for (VkImageMemoryBarrier& imageBarrier : imageBarriers)
+	{
+		imageBarrier.srcAccessMask = 0;
+	}
+}
+
+void BarrierBatch::orderBeforeLaterCommands()
+{
+	dstStageMask = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+	memoryBarrier.dstAccessMask = 0;
+	for (VkImageMemoryBarrier& imageBarrier : imageBarriers)
+	{
+		imageBarrier.dstAccessMask = 0;
+	}
+}
+
+VkPipelineStageFlags BarrierBatch::getSrcStageMask() const
+{
+	return srcStageMask;
+}
+
+VkPipelineStageFlags BarrierBatch::getDstStageMask() const
+{
+	return dstStageMask;
+}
+
+bool BarrierBatch::isEmpty() const
+{
+	return !hasMemoryBarrier && imageBarriers.empty();
+}
+
+void BarrierBatch::record(VkCommandBuffer commandBuffer) const
+{
+	if (isEmpty())
+	{
+		return;
+	}
+
+	vkCmdPipelineBarrier(
+		commandBuffer,
+		srcStageMask,
+		dstStageMask,
+		0,
+		hasMemoryBarrier ? 1 : 0, hasMemoryBarrier ? &memoryBarrier : nullptr,
+		0, VK_NULL_HANDLE,
+		static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data()
+	);
+}
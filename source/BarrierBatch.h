@@ -0,0 +1,86 @@
+#pragma once
+
+#include <vector>
+
+#include "VulkanCore.h"
+
+/**
+* @brief Collection of memory and image barriers recorded together in a single vkCmdPipelineBarrier call.
+*
+* Stage masks of all added barriers are merged. Global memory barriers are merged into one.
+*/
+class BarrierBatch
+{
+public:
+
+	/**
+	* @brief Adds a global memory barrier.
+	*
+	* @param srcStageMask stages to wait for
+	* @param dstStageMask stages that wait
+	* @param srcAccessMask accesses to make available
+	* @param dstAccessMask accesses to make visible
+	*/
+	void addMemoryBarrier(VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask, VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask);
+
+	/**
+	* @brief Adds an image memory barrier.
+	*
+	* @param srcStageMask stages to wait for
+	* @param dstStageMask stages that wait
+	* @param barrier image barrier to add
+	*/
+	void addImageBarrier(VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask, const VkImageMemoryBarrier& barrier);
+
+	/**
+	* @brief Makes the barriers wait for all earlier commands instead of the stages they were added with, without making any accesses available.
+	*
+	* For barriers whose previous accesses were made on another queue. The semaphore wait ordering the submission after them already made their writes available, so only layout transitions remain to be ordered after the wait, whichever stages it waits at.
+	*/
+	void orderAfterSemaphoreWait();
+
+	/**
+	* @brief Makes all later commands wait for the barriers instead of the stages they were added with, without making any accesses visible.
+	*
+	* For barriers recorded on a queue that may not support the stages of the accesses following them, such as the transfer queue. A later barrier or the semaphore wait of the submission using the resources makes their writes visible.
+	*/
+	void orderBeforeLaterCommands();
+
+	/**
+	* @brief Returns the stages the barriers wait for.
+	*
+	* @return merged source stage mask
+	*/
+	VkPipelineStageFlags getSrcStageMask() const;
+
+	/**
+	* @brief Returns the stages that wait for the barriers.
+	*
+	* @return merged destination stage mask
+	*/
+	VkPipelineStageFlags getDstStageMask() const;
+
+	/**
+	* @brief Returns whether no barriers have been added.
+	*
+	* @return whether this batch is empty
+	*/
+	bool isEmpty() const;
+
+	/**
+	* @brief Records all added barriers. Records nothing if the batch is empty.
+	*
+	* @param commandBuffer command buffer to record to
+	*/
+	void record(VkCommandBuffer commandBuffer) const;
+
+private:
+
+	VkPipelineStageFlags srcStageMask = 0;
+	VkPipelineStageFlags dstStageMask = 0;
+
+	bool hasMemoryBarrier = false;
+	VkMemoryBarrier memoryBarrier{ VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+
+	std::vector<VkImageMemoryBarrier> imageBarriers;
+};
@@ -1,7 +1,8 @@
 #include "Buffer.h"
 #include <stdexcept>
+#include <algorithm>
 
-const std::unordered_map<Resource::ACCESS_PROPERTY, void (Buffer::*)(VkDeviceSize, const void*)> Buffer::DATA_TRANSFER_FUNCTIONS =
+const std::unordered_map<Resource::ACCESS_PROPERTY, void (Buffer::*)(uint32_t, const std::vector<Buffer::UpdateRange>&)> Buffer::DATA_TRANSFER_FUNCTIONS =
 {
 	{Resource::ACCESS_PROPERTY::CPU_PREFERRED, &copyDataDirect},
 	{Resource::ACCESS_PROPERTY::GPU_PREFERRED, &copyDataStaging}
@@ -28,25 +29,106 @@ VkBufferUsageFlags Buffer::getUsageFlags(Resource::ACCESS_PROPERTY accessPropert
 	return ACCESS_PROPERTY_USAGE_FLAGS.at(accessProperty) | USE_USAGE_FLAGS.at(use);
 }
 
-void Buffer::copyDataDirect(VkDeviceSize bufferSize, const void* data)
+// a contiguous range of a Buffer covered by updates that overlap or touch
+struct DirtyRange
 {
-	void* destinationData;
+	VkDeviceSize offset;
+	VkDeviceSize size;
 
-	vmaMapMemory(getVulkanCoreSupport().getVmaAllocator(), bufferAllocation, &destinationData);
-	memcpy(destinationData, data, (size_t)bufferSize);
-	vmaUnmapMemory(getVulkanCoreSupport().getVmaAllocator(), bufferAllocation);
+	// updates within the range, in the order they were given
+	std::vector<const Buffer::UpdateRange*> updates;
+
+	// writes the new content of the range to destination
+	void write(uint8_t* destination) const
+	{
+		for (const Buffer::UpdateRange* update : updates)
+		{
+			memcpy(destination + (update->offset - offset), update->data, static_cast<size_t>(update->size));
+		}
+	}
+};
+
+std::vector<DirtyRange> coalesceRanges(const std::vector<Buffer::UpdateRange>& ranges)
+{
+	std::vector<const Buffer::UpdateRange*> sortedRanges;
+	for (const Buffer::UpdateRange& range : ranges)
+	{
+		if (range.size > 0)
+		{
+			sortedRanges.push_back(&range);
+		}
+	}
+	std::stable_sort(sortedRanges.begin(), sortedRanges.end(), [](const Buffer::UpdateRange* a, const Buffer::UpdateRange* b) { return a->offset < b->offset; });
+
+	std::vector<DirtyRange> dirtyRanges;
+	for (const Buffer::UpdateRange* range : sortedRanges)
+	{
+		if (!dirtyRanges.empty() && range->offset <= dirtyRanges.back().offset + dirtyRanges.back().size)
+		{
+			DirtyRange& dirtyRange = dirtyRanges.back();
+			dirtyRange.size = std::max(dirtyRange.offset + dirtyRange.size, range->offset + range->size) - dirtyRange.offset;
+			dirtyRange.updates.push_back(range);
+		}
+		else
+		{
+			dirtyRanges.push_back(DirtyRange{ range->offset, range->size, { range } });
+		}
+	}
+
+	// the pointers are into ranges, so their order is the order the updates were given in, which decides overlaps
+	for (DirtyRange& dirtyRange : dirtyRanges)
+	{
+		std::sort(dirtyRange.updates.begin(), dirtyRange.updates.end());
+	}
+
+	return dirtyRanges;
 }
 
-void Buffer::copyDataStaging(VkDeviceSize bufferSize, const void* data)
+void Buffer::copyDataDirect(uint32_t version, const std::vector<UpdateRange>& ranges)
 {
-	// create staging buffer, copy data to staging buffer, copy staging buffer to this buffer
+	// the host writes the memory frames read, so it has to wait until they're done with it
+	waitForHostAccess(version);
+
+	for (const DirtyRange& dirtyRange : coalesceRanges(ranges))
+	{
+		dirtyRange.write(static_cast<uint8_t*>(mappedData.at(version)) + dirtyRange.offset);
+		vmaFlushAllocation(getVulkanCoreSupport().getVmaAllocator(), bufferAllocations.at(version), bufferOffsets.at(version) + dirtyRange.offset, dirtyRange.size);
+	}
+}
 
-	// create temp staging buffer
-	Buffer stagingBuffer(getVulkanCoreSupport(), byteSize, AccessSpecifier::OPERATION::TRANSFER_SOURCE, ACCESS_PROPERTY::CPU_PREFERRED, data);
-	stagingBuffer.initialize();
+void Buffer::copyDataStaging(uint32_t version, const std::vector<UpdateRange>& ranges)
+{
+	// device local memory the host can write needs no staging copy
+	if (mappedData.at(version) != nullptr)
+	{
+		copyDataDirect(version, ranges);
+		return;
+	}
 
-	// copy data to GPU buffer
-	copyBuffer(stagingBuffer);
+	// each dirty range is staged and copied once, however many updates it merges. executeUploadCommands orders the copies after earlier uploads, which may overlap them
+	for (const DirtyRange& dirtyRange : coalesceRanges(ranges))
+	{
+		auto write = [&dirtyRange](void* destination)
+		{
+			dirtyRange.write(static_cast<uint8_t*>(destination));
+		};
+
+		// data is staged in the shared ring buffer, so updates need neither an allocation nor a wait. The upload waits for the frames using the Buffer on the GPU instead
+		StagingRegion stagingRegion;
+		if (getVulkanCoreSupport().stageUploadData(dirtyRange.size, write, stagingRegion))
+		{
+			copyBuffer(stagingRegion.buffer, stagingRegion.offset, dirtyRange.offset, dirtyRange.size, version);
+			continue;
+		}
+
+		// data too large for the ring buffer gets a temp staging buffer. The upload keeps it alive until the copy completes
+		auto stagingBuffer = std::make_shared<Buffer>(getVulkanCoreSupport(), dirtyRange.size, AccessSpecifier::OPERATION::TRANSFER_SOURCE, ACCESS_PROPERTY::CPU_PREFERRED);
+		stagingBuffer->initialize();
+		write(stagingBuffer->mappedData.at(0));
+		vmaFlushAllocation(getVulkanCoreSupport().getVmaAllocator(), stagingBuffer->bufferAllocations.at(0), 0, VK_WHOLE_SIZE);
+
+		copyBuffer(stagingBuffer->bufferObjects.at(0), 0, dirtyRange.offset, dirtyRange.size, version, [stagingBuffer]() {});
+	}
 }
 
 void Buffer::setDataTransferFunction(Resource::ACCESS_PROPERTY accessProperty)
@@ -56,36 +138,180 @@ void Buffer::setDataTransferFunction(Resource::ACCESS_PROPERTY accessProperty)
 
 void Buffer::copyData(VkDeviceSize size, const void* data)
 {
-	waitForReady();
+	update(0, size, data);
+}
+
+void Buffer::update(VkDeviceSize offset, VkDeviceSize size, const void* data)
+{
+	update({ UpdateRange{ offset, size, data } });
+}
+
+void Buffer::update(const std::vector<UpdateRange>& ranges)
+{
+	// a Buffer used only by culled passes is never created, so there's nothing to update
+	if (bufferObjects.empty())
+	{
+		return;
+	}
+
+	for (const UpdateRange& range : ranges)
+	{
+		if (range.offset + range.size > byteSize)
+		{
+			throw std::runtime_error("update exceeds buffer size");
+		}
+	}
+
+	uint32_t currentVersion = getVersion(getVulkanCoreSupport().getFrameSlot());
+
+	// the other versions are in use by frames in flight, so they get the update once their frame slot comes up
+	if (updateFrequency == UPDATE_FREQUENCY::PER_FRAME)
+	{
+		for (const DirtyRange& dirtyRange : coalesceRanges(ranges))
+		{
+			PendingUpdate pendingUpdate{ dirtyRange.offset, std::vector<uint8_t>(static_cast<size_t>(dirtyRange.size)) };
+			dirtyRange.write(pendingUpdate.data.data());
+
+			for (uint32_t version = 0; version < getNumVersions(); version++)
+			{
+				if (version != currentVersion)
+				{
+					pendingUpdates.at(version).push_back(pendingUpdate);
+				}
+			}
+		}
+	}
+
+	writeVersion(currentVersion, ranges);
+}
+
+void Buffer::writeVersion(uint32_t version, const std::vector<UpdateRange>& ranges)
+{
+	// earlier updates come first, so later ones take precedence where they overlap
+	std::vector<UpdateRange> orderedRanges;
+	for (const PendingUpdate& pendingUpdate : pendingUpdates.at(version))
+	{
+		orderedRanges.push_back(UpdateRange{ pendingUpdate.offset, pendingUpdate.data.size(), pendingUpdate.data.data() });
+	}
+	orderedRanges.insert(orderedRanges.end(), ranges.begin(), ranges.end());
+
+	if (orderedRanges.empty())
+	{
+		return;
+	}
+
+	(*this.*dataTransferFunction)(version, orderedRanges);
+	pendingUpdates.at(version).clear();
+}
+
+void Buffer::prepareForFrame(uint32_t frameSlot)
+{
+	if (updateFrequency != UPDATE_FREQUENCY::PER_FRAME || bufferObjects.empty())
+	{
+		return;
+	}
+
+	writeVersion(getVersion(frameSlot), {});
+}
+
+void Buffer::readData(VkDeviceSize size, void* data)
+{
+	uint32_t version = getVersion(getVulkanCoreSupport().getFrameSlot());
 
-	(*this.*dataTransferFunction)(size, data);
+	vmaInvalidateAllocation(getVulkanCoreSupport().getVmaAllocator(), bufferAllocations.at(version), bufferOffsets.at(version), size);
+	memcpy(data, mappedData.at(version), (size_t)size);
 }
 
-void Buffer::copyBuffer(const Buffer& otherBuffer)
+void Buffer::flush(VkDeviceSize offset, VkDeviceSize size)
 {
-	auto command = [&otherBuffer, this](VkCommandBuffer commandBuffer)
+	if (bufferObjects.empty())
+	{
+		return;
+	}
+
+	uint32_t version = getVersion(getVulkanCoreSupport().getFrameSlot());
+
+	// VK_WHOLE_SIZE would reach past the end of a slice
+	VkDeviceSize flushedSize = size == VK_WHOLE_SIZE ? byteSize - offset : size;
+	vmaFlushAllocation(getVulkanCoreSupport().getVmaAllocator(), bufferAllocations.at(version), bufferOffsets.at(version) + offset, flushedSize);
+}
+
+bool Buffer::isHostVisible() const
+{
+	return !bufferObjects.empty() && mappedData.at(getVersion(getVulkanCoreSupport().getFrameSlot())) != nullptr;
+}
+
+void Buffer::waitForHostAccess(uint32_t version) const
+{
+	// a per-frame version is only used by the frames in the slot of the same index
+	if (updateFrequency == UPDATE_FREQUENCY::PER_FRAME)
+	{
+		waitForReady(version);
+	}
+	else
+	{
+		waitForReady();
+	}
+}
+
+void* Buffer::getMappedData()
+{
+	// a Buffer used only by culled passes is never created, so there's nothing to write
+	if (bufferObjects.empty())
+	{
+		return nullptr;
+	}
+
+	uint32_t version = getVersion(getVulkanCoreSupport().getFrameSlot());
+	waitForHostAccess(version);
+	if (mappedData.at(version) == nullptr)
+	{
+		throw std::runtime_error("buffer memory is not host visible");
+	}
+
+	// updates made in other frame slots would otherwise overwrite the writes once applied
+	writeVersion(version, {});
+
+	return mappedData.at(version);
+}
+
+void Buffer::copyBuffer(VkBuffer source, VkDeviceSize sourceOffset, VkDeviceSize destinationOffset, VkDeviceSize size, uint32_t version, std::function<void()> onComplete)
+{
+	auto command = [source, sourceOffset, destinationOffset, size, version, this](VkCommandBuffer commandBuffer)
 	{
 		VkBufferCopy copyRegion{};
-		copyRegion.size = otherBuffer.byteSize;
-		vkCmdCopyBuffer(commandBuffer, otherBuffer.bufferObject, bufferObject, 1, &copyRegion);
+		copyRegion.srcOffset = sourceOffset;
+		copyRegion.dstOffset = bufferOffsets.at(version) + destinationOffset;
+		copyRegion.size = size;
+		vkCmdCopyBuffer(commandBuffer, source, bufferObjects.at(version), 1, &copyRegion);
 	};
 
-	getVulkanCoreSupport().executeInstantCommands(command);
+	// the copy runs on the transfer queue while the host moves on. It waits only for the submissions using the overwritten version, and passes wait for it
+	uint64_t lastUse = updateFrequency == UPDATE_FREQUENCY::PER_FRAME ? getLastUseSubmission(version) : getLastUseSubmission();
+	uint64_t submission = getVulkanCoreSupport().executeUploadCommands(command, onComplete, lastUse);
+
+	// a PER_FRAME version is used by the frame slot of the same index, and STATIC Buffers wait for every slot, so the version identifies the slot to register with
+	registerSubmission(submission, version);
 }
 
-Buffer::Buffer(VulkanCore& vulkanCoreSupport, VkDeviceSize size, AccessSpecifier::OPERATION use, ACCESS_PROPERTY accessProperty, const void* data) : byteSize(size), Resource(vulkanCoreSupport)
+Buffer::Buffer(VulkanCore& vulkanCoreSupport, VkDeviceSize size, AccessSpecifier::OPERATION use, ACCESS_PROPERTY accessProperty, const void* data, UPDATE_FREQUENCY updateFrequency, ALLOCATION allocation) : byteSize(size), updateFrequency(updateFrequency), allocation(allocation), Resource(vulkanCoreSupport)
 {
 	setDataTransferFunction(accessProperty);
 
 	initializeFunction = [this, accessProperty, use, size, data]()
 	{
 		createBuffer(accessProperty, use);
-		copyData(size, data);
+
+		// nothing uses the Buffer yet, so every version can be filled without waiting
+		for (uint32_t version = 0; version < getNumVersions(); version++)
+		{
+			(*this.*dataTransferFunction)(version, { UpdateRange{ 0, size, data } });
+		}
 	};
 }
 
 
-Buffer::Buffer(VulkanCore& vulkanCoreSupport, VkDeviceSize size, AccessSpecifier::OPERATION use, ACCESS_PROPERTY accessProperty) : byteSize(size), Resource(vulkanCoreSupport)
+Buffer::Buffer(VulkanCore& vulkanCoreSupport, VkDeviceSize size, AccessSpecifier::OPERATION use, ACCESS_PROPERTY accessProperty, UPDATE_FREQUENCY updateFrequency, ALLOCATION allocation) : byteSize(size), updateFrequency(updateFrequency), allocation(allocation), Resource(vulkanCoreSupport)
 {
 	setDataTransferFunction(accessProperty);
 
@@ -98,13 +324,53 @@ Buffer::Buffer(VulkanCore& vulkanCoreSupport, VkDeviceSize size, AccessSpecifier
 
 Buffer::~Buffer()
 {
-	vmaDestroyBuffer(getVulkanCoreSupport().getVmaAllocator(), bufferObject, bufferAllocation);
+	if (arena != nullptr)
+	{
+		// a freed slice may be handed to the next Buffer right away, whose writes would corrupt what frames in flight still read
+		waitForReady();
+
+		for (const BufferSlice& slice : slices)
+		{
+			arena->free(slice);
+		}
+		return;
+	}
+
+	for (size_t i = 0; i < bufferObjects.size(); i++)
+	{
+		vmaDestroyBuffer(getVulkanCoreSupport().getVmaAllocator(), bufferObjects.at(i), bufferAllocations.at(i));
+	}
 };
 
 
 const VkBuffer& Buffer::getBufferObject() const
 {
-	return bufferObject;
+	return getBufferObject(getVulkanCoreSupport().getFrameSlot());
+}
+
+const VkBuffer& Buffer::getBufferObject(uint32_t frameSlot) const
+{
+	return bufferObjects.at(getVersion(frameSlot));
+}
+
+VkDeviceSize Buffer::getOffset() const
+{
+	return getOffset(getVulkanCoreSupport().getFrameSlot());
+}
+
+VkDeviceSize Buffer::getOffset(uint32_t frameSlot) const
+{
+	return bufferOffsets.at(getVersion(frameSlot));
+}
+
+uint32_t Buffer::getVersion(uint32_t frameSlot) const
+{
+	return updateFrequency == UPDATE_FREQUENCY::PER_FRAME ? frameSlot : 0;
+}
+
+uint32_t Buffer::getNumVersions() const
+{
+	return updateFrequency == UPDATE_FREQUENCY::PER_FRAME ? getVulkanCoreSupport().getFramesInFlight() : 1;
 }
 
 // TODO behavior on non-descriptor resources
@@ -117,11 +383,11 @@ void Buffer::createLayoutBinding(int index, AccessSpecifier access, VkDescriptor
 	out.pImmutableSamplers = nullptr;
 }
 
-void Buffer::createDescriptorWrite(int index, AccessSpecifier access, const VkDescriptorSet& descriptorSet, VkWriteDescriptorSet& out) const
+void Buffer::createDescriptorWrite(int index, AccessSpecifier access, const VkDescriptorSet& descriptorSet, uint32_t frameSlot, VkWriteDescriptorSet& out) const
 {
 	VkDescriptorBufferInfo descriptorBufferInfo{};
-	descriptorBufferInfo.buffer = bufferObject;
-	descriptorBufferInfo.offset = 0;
+	descriptorBufferInfo.buffer = getBufferObject(frameSlot);
+	descriptorBufferInfo.offset = getOffset(frameSlot);
 	descriptorBufferInfo.range = byteSize;
 
 	out.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
@@ -144,13 +410,76 @@ void Buffer::createBuffer(Resource::ACCESS_PROPERTY accessProperty, AccessSpecif
 	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
 	bufferInfo.size = byteSize;
 	bufferInfo.usage = getUsageFlags(accessProperty, use);
-	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	// resources used on several queues are shared concurrently instead of transferring ownership between them
+	std::vector<uint32_t> queueFamilyIndices = getVulkanCoreSupport().getResourceQueueFamilyIndices();
+	bufferInfo.sharingMode = queueFamilyIndices.size() > 1 ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE;
+	bufferInfo.queueFamilyIndexCount = static_cast<uint32_t>(queueFamilyIndices.size());
+	bufferInfo.pQueueFamilyIndices = queueFamilyIndices.data();
 
 	VmaAllocationCreateInfo allocationInfo{};
 	allocationInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
 	allocationInfo.usage = VMA_MEMORY_USAGE_AUTO;
 
-	vmaCreateBuffer(getVulkanCoreSupport().getVmaAllocator(), &bufferInfo, &allocationInfo, &bufferObject, &bufferAllocation, nullptr);
+	// readback buffers are read by the host, so they need cached memory
+	if (accessProperty == ACCESS_PROPERTY::CPU_PREFERRED && use == AccessSpecifier::OPERATION::TRANSFER_DESTINATION)
+	{
+		allocationInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT;
+	}
+
+	// mapping on every update is a driver call, so host accessed memory is mapped once for good
+	if (accessProperty == ACCESS_PROPERTY::CPU_PREFERRED)
+	{
+		allocationInfo.flags |= VMA_ALLOCATION_CREATE_MAPPED_BIT;
+	}
+	// GPU_PREFERRED memory prefers to be host visible if all of the device memory is, falling back to staging if that memory runs out
+	else if (getVulkanCoreSupport().hasHostVisibleDeviceMemory())
+	{
+		allocationInfo.flags |= VMA_ALLOCATION_CREATE_HOST_ACCESS_ALLOW_TRANSFER_INSTEAD_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+		allocationInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+		allocationInfo.preferredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+	}
+	// otherwise it's never host accessed, so it lands in memory the host can't see
+	else
+	{
+		allocationInfo.flags = 0;
+		allocationInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+	}
+
+	bufferObjects.resize(getNumVersions());
+	bufferAllocations.resize(getNumVersions());
+	bufferOffsets.resize(getNumVersions(), 0);
+	mappedData.resize(getNumVersions(), nullptr);
+	pendingUpdates.resize(getNumVersions());
+
+	// the arena's blocks are placed like this Buffer would be, so slices behave the same as dedicated versions
+	if (allocation == ALLOCATION::SUBALLOCATED && byteSize <= BufferArena::MAX_SLICE_SIZE)
+	{
+		arena = &getVulkanCoreSupport().getBufferArena(bufferInfo.usage, allocationInfo);
+		slices.resize(getNumVersions());
+
+		for (uint32_t version = 0; version < getNumVersions(); version++)
+		{
+			BufferSlice& slice = slices.at(version);
+			arena->allocate(byteSize, slice);
+
+			bufferObjects.at(version) = slice.buffer;
+			bufferAllocations.at(version) = slice.allocation;
+			bufferOffsets.at(version) = slice.offset;
+			mappedData.at(version) = slice.mappedData;
+		}
+		return;
+	}
+
+	for (uint32_t version = 0; version < getNumVersions(); version++)
+	{
+		VmaAllocationInfo allocationResult{};
+		vmaCreateBuffer(getVulkanCoreSupport().getVmaAllocator(), &bufferInfo, &allocationInfo, &bufferObjects.at(version), &bufferAllocations.at(version), &allocationResult);
+
+		// the placement of every version is checked, since a version may have fallen back to memory the host can't see
+		VkMemoryPropertyFlags memoryProperties = 0;
+		vmaGetAllocationMemoryProperties(getVulkanCoreSupport().getVmaAllocator(), bufferAllocations.at(version), &memoryProperties);
+		mappedData.at(version) = (memoryProperties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) ? allocationResult.pMappedData : nullptr;
+	}
 }
 
 void Buffer::prepareForInitialAccess(VkCommandBuffer& commandBuffer, AccessSpecifier currentAccess)
@@ -158,28 +487,18 @@ void Buffer::prepareForInitialAccess(VkCommandBuffer& commandBuffer, AccessSpeci
 
 }
 
-void Buffer::insertBarrier(VkCommandBuffer& commandBuffer, AccessSpecifier previousAccess, AccessSpecifier currentAccess)
+void Buffer::addBarrier(BarrierBatch& batch, const std::vector<AccessSpecifier>& previousAccesses, AccessSpecifier currentAccess, bool discardContent)
 {
-	auto previousAccessMask = getAccessFlag(previousAccess);
-	auto currentAccessMask = getAccessFlag(currentAccess);
+	VkAccessFlags previousAccessMask = 0;
+	VkPipelineStageFlags previousStageMask = 0;
+	for (const AccessSpecifier& previousAccess : previousAccesses)
+	{
+		previousAccessMask |= getAccessFlag(previousAccess);
+		previousStageMask |= getPipelineStageFlag(previousAccess);
+	}
 
-	auto previousStageMask = getPipelineStageFlag(previousAccess);
+	auto currentAccessMask = getAccessFlag(currentAccess);
 	auto currentStageMask = getPipelineStageFlag(currentAccess);
 
-	VkMemoryBarrier barrier{};
-	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
-	barrier.srcAccessMask = previousAccessMask;
-	barrier.dstAccessMask = currentAccessMask;
-
-	vkCmdPipelineBarrier(
-		commandBuffer,
-		previousStageMask,
-		currentStageMask,
-		0,
-		1, &barrier,
-		0, VK_NULL_HANDLE,
-		0, VK_NULL_HANDLE
-	);
-
-	auto x = 2;
+	batch.addMemoryBarrier(previousStageMask, currentStageMask, previousAccessMask, currentAccessMask);
 }
@@ -2,6 +2,7 @@
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 #include <unordered_map>
+#include <memory>
 #include "VulkanCore.h"
 #include "Resource.h"
 
@@ -12,6 +13,41 @@ class Buffer : public Resource
 {
 public:
 
+	/**
+	* @brief Indication of how often the host updates a Buffer's contents.
+	*/
+	enum UPDATE_FREQUENCY
+	{
+		/// Contents rarely change. A single copy is shared by all frames
+		STATIC,
+		/// Contents are updated every frame. One copy is kept per frame slot so the host can write while earlier frames are still in flight
+		PER_FRAME,
+	};
+
+	/**
+	* @brief Indication of how a Buffer's memory is allocated.
+	*/
+	enum ALLOCATION
+	{
+		/// The Buffer has a buffer object and allocation of its own
+		DEDICATED,
+		/// The Buffer is a slice of a buffer object shared with Buffers of the same use and access property, which saves allocations and binds. Buffers larger than BufferArena::MAX_SLICE_SIZE are dedicated regardless
+		SUBALLOCATED,
+	};
+
+	/**
+	* @brief Part of a Buffer to update, along with its new content.
+	*/
+	struct UpdateRange
+	{
+		/// offset of the range in bytes
+		VkDeviceSize offset;
+		/// size of the range in bytes
+		VkDeviceSize size;
+		/// new content of the range
+		const void* data;
+	};
+
 	/**
 	* @brief Creates a Buffer filled with data.
 	* 
@@ -19,8 +55,10 @@ public:
 	* @param use how buffer will be used
 	* @param accessProperty memory location preference
 	* @param data pointer to data to fill buffer with
+	* @param updateFrequency how often the host updates the contents
+	* @param allocation how the memory is allocated
 	*/
-	Buffer(VulkanCore& vulkanCoreSupport, VkDeviceSize size, AccessSpecifier::OPERATION use, ACCESS_PROPERTY accessProperty, const void* data);
+	Buffer(VulkanCore& vulkanCoreSupport, VkDeviceSize size, AccessSpecifier::OPERATION use, ACCESS_PROPERTY accessProperty, const void* data, UPDATE_FREQUENCY updateFrequency = UPDATE_FREQUENCY::STATIC, ALLOCATION allocation = ALLOCATION::DEDICATED);
 
 	/**
 	* @brief Creates an empty Buffer filled.
@@ -28,8 +66,10 @@ public:
 	* @param size size of buffer in bytes
 	* @param use how buffer will be used
 	* @param accessProperty memory location preference
+	* @param updateFrequency how often the host updates the contents
+	* @param allocation how the memory is allocated
 	*/
-	Buffer(VulkanCore& vulkanCoreSupport, VkDeviceSize size, AccessSpecifier::OPERATION use, ACCESS_PROPERTY accessProperty);
+	Buffer(VulkanCore& vulkanCoreSupport, VkDeviceSize size, AccessSpecifier::OPERATION use, ACCESS_PROPERTY accessProperty, UPDATE_FREQUENCY updateFrequency = UPDATE_FREQUENCY::STATIC, ALLOCATION allocation = ALLOCATION::DEDICATED);
 
 	Buffer(const Buffer&) = delete;
 	Buffer(Buffer&&) = delete;
@@ -42,40 +82,154 @@ public:
 	~Buffer();
 
 	/**
-	* @brief Returns underlying vulkan buffer object.
+	* @brief Returns underlying vulkan buffer object used by the frame the host is currently preparing.
 	* 
 	* @return vulkan buffer object
 	*/
 	const VkBuffer& getBufferObject() const;
+
+	/**
+	* @brief Returns underlying vulkan buffer object used by frames in frameSlot.
+	*
+	* @param frameSlot frame slot
+	* @return vulkan buffer object
+	*/
+	const VkBuffer& getBufferObject(uint32_t frameSlot) const;
+
+	/**
+	* @brief Returns where the contents used by the frame the host is currently preparing start within getBufferObject(). Only non-zero for SUBALLOCATED Buffers.
+	*
+	* @return offset in bytes
+	*/
+	VkDeviceSize getOffset() const;
+
+	/**
+	* @brief Returns where the contents used by frames in frameSlot start within getBufferObject(frameSlot).
+	*
+	* @param frameSlot frame slot
+	* @return offset in bytes
+	*/
+	VkDeviceSize getOffset(uint32_t frameSlot) const;
 	
 	/**
-	* @brief Copies data to this Buffer.
+	* @brief Copies data to this Buffer. A PER_FRAME Buffer updates the copy of the frame the host is currently preparing right away, and the copies of the other frame slots before their next frames are submitted.
 	* 
 	* @param size size of data to copy in bytes
 	* @param data data to copy to buffer
 	*/
 	void copyData(VkDeviceSize size, const void* data);
 
+	/**
+	* @brief Copies data to a range of this Buffer, leaving the rest untouched. Copies through staging don't wait for frames using the Buffer. A PER_FRAME Buffer updates the copy of the frame the host is currently preparing right away, and the copies of the other frame slots before their next frames are submitted.
+	*
+	* @param offset offset of the range in bytes
+	* @param size size of the range in bytes
+	* @param data data to copy to the range
+	*/
+	void update(VkDeviceSize offset, VkDeviceSize size, const void* data);
+
+	/**
+	* @brief Copies data to several ranges of this Buffer at once. Overlapping and adjacent ranges are merged into a single copy, with ranges later in ranges taking precedence where they overlap.
+	*
+	* @param ranges ranges to update
+	*/
+	void update(const std::vector<UpdateRange>& ranges);
+
+	/**
+	* @brief Copies data from this Buffer to host memory. Only valid for CPU_PREFERRED Buffers.
+	* 
+	* @param size size of data to copy in bytes
+	* @param data destination of the copy
+	*/
+	void readData(VkDeviceSize size, void* data);
+
+	/**
+	* @brief Returns the persistently mapped contents used by the frame the host is currently preparing, so they can be written in place. Unlike update, writes only reach the copy of this frame slot. Waits until no submission uses them. Only valid if isHostVisible().
+	*
+	* @return mapped contents, or nullptr if the Buffer was never created because only culled passes use it
+	*/
+	template<typename T>
+	T* mapped()
+	{
+		return static_cast<T*>(getMappedData());
+	}
+
+	/**
+	* @brief Makes writes through mapped() visible to the device. Only does work if the memory is not host coherent.
+	*
+	* @param offset offset of the written range in bytes
+	* @param size size of the written range in bytes
+	*/
+	void flush(VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+
+	/**
+	* @brief Checks whether the host can write the contents used by the frame the host is currently preparing directly. Always true for CPU_PREFERRED Buffers, and true for GPU_PREFERRED Buffers placed in device local memory the host can access.
+	*
+	* @return whether the contents are host visible
+	*/
+	bool isHostVisible() const;
+
 	void createLayoutBinding(int index, AccessSpecifier access, VkDescriptorSetLayoutBinding& out) const override;
-	void createDescriptorWrite(int index, AccessSpecifier access, const VkDescriptorSet& descriptorSet, VkWriteDescriptorSet& out) const override;
+	void createDescriptorWrite(int index, AccessSpecifier access, const VkDescriptorSet& descriptorSet, uint32_t frameSlot, VkWriteDescriptorSet& out) const override;
 
 	void prepareForInitialAccess(VkCommandBuffer& commandBuffer, AccessSpecifier currentAccess) override;
 
-	void insertBarrier(VkCommandBuffer& commandBuffer, AccessSpecifier previousAccess, AccessSpecifier currentAccess) override;
+	void addBarrier(BarrierBatch& batch, const std::vector<AccessSpecifier>& previousAccesses, AccessSpecifier currentAccess, bool discardContent = false) override;
+
+	void prepareForFrame(uint32_t frameSlot) override;
 
 private:
-	static const std::unordered_map<ACCESS_PROPERTY, void (Buffer::*)(VkDeviceSize, const void*)> DATA_TRANSFER_FUNCTIONS;
+	static const std::unordered_map<ACCESS_PROPERTY, void (Buffer::*)(uint32_t, const std::vector<UpdateRange>&)> DATA_TRANSFER_FUNCTIONS;
 	static const std::unordered_map<ACCESS_PROPERTY, VkBufferUsageFlags> ACCESS_PROPERTY_USAGE_FLAGS;
 	static const std::unordered_map<AccessSpecifier::OPERATION, VkBufferUsageFlags> USE_USAGE_FLAGS;
 
 	// size in bytes
 	const VkDeviceSize byteSize;
 
-	VkBuffer bufferObject;
+	const UPDATE_FREQUENCY updateFrequency;
+
+	const ALLOCATION allocation;
+
+	// one buffer and allocation per version. STATIC Buffers have a single version, PER_FRAME Buffers one per frame slot
+	std::vector<VkBuffer> bufferObjects;
+
+	// allocations of the whole buffer objects, which suballocated versions share with other Buffers
+	std::vector<VmaAllocation> bufferAllocations;
+
+	// where each version starts within its buffer object
+	std::vector<VkDeviceSize> bufferOffsets;
+
+	// arena the versions are slices of. nullptr if they're dedicated
+	BufferArena* arena = nullptr;
+
+	std::vector<BufferSlice> slices;
+
+	// host-visible versions stay mapped for the lifetime of the Buffer. nullptr for versions the host can't access, which are written through staging
+	std::vector<void*> mappedData;
+
+	void (Buffer::*dataTransferFunction)(uint32_t, const std::vector<UpdateRange>&);
+
+	// content of a range updated while another version was current
+	struct PendingUpdate
+	{
+		VkDeviceSize offset;
+		std::vector<uint8_t> data;
+	};
+
+	// per version, updates still to be applied to it, in the order they were made. Only PER_FRAME Buffers have any
+	std::vector<std::vector<PendingUpdate>> pendingUpdates;
+
+	// writes the pending updates of version followed by ranges to version
+	void writeVersion(uint32_t version, const std::vector<UpdateRange>& ranges);
+
+	uint32_t getVersion(uint32_t frameSlot) const;
+
+	uint32_t getNumVersions() const;
 
-	VmaAllocation bufferAllocation;
+	// waits until no submission uses version, so the host may write it
+	void waitForHostAccess(uint32_t version) const;
 
-	void (Buffer::*dataTransferFunction)(VkDeviceSize, const void*);
+	void* getMappedData();
 
 	void setDataTransferFunction(Resource::ACCESS_PROPERTY accessProperty);
 
@@ -83,8 +237,9 @@ private:
 
 	void createBuffer(Resource::ACCESS_PROPERTY accessProperty, AccessSpecifier::OPERATION use);
 	
-	void copyBuffer(const Buffer& otherBuffer);
+	// uploads size bytes of source starting at sourceOffset to version starting at destinationOffset. onComplete is called once the copy has completed
+	void copyBuffer(VkBuffer source, VkDeviceSize sourceOffset, VkDeviceSize destinationOffset, VkDeviceSize size, uint32_t version, std::function<void()> onComplete = nullptr);
 
-	void copyDataDirect(VkDeviceSize bufferSize, const void* data);
-	void copyDataStaging(VkDeviceSize bufferSize, const void* data);
+	void copyDataDirect(uint32_t version, const std::vector<UpdateRange>& ranges);
+	void copyDataStaging(uint32_t version, const std::vector<UpdateRange>& ranges);
 };
\ No newline at end of file
@@ -0,0 +1,109 @@
+#include "BufferArena.h"
+#include <stdexcept>
+
+BufferArena::BufferArena(VmaAllocator allocator, VkBufferUsageFlags usage, const std::vector<uint32_t>& queueFamilyIndices, const VmaAllocationCreateInfo& allocationInfo, VkDeviceSize alignment)
+	: allocator(allocator), usage(usage), queueFamilyIndices(queueFamilyIndices), allocationInfo(allocationInfo), alignment(alignment)
+{
+}
+
+BufferArena::~BufferArena()
+{
+	for (Block& block : blocks)
+	{
+		// slices of Buffers destroyed after the arena are gone with it
+		vmaClearVirtualBlock(block.virtualBlock);
+		vmaDestroyVirtualBlock(block.virtualBlock);
+		vmaDestroyBuffer(allocator, block.buffer, block.allocation);
+	}
+}
+
+bool BufferArena::allocate(VkDeviceSize size, BufferSlice& slice)
+{
+	if (size > MAX_SLICE_SIZE)
+	{
+		return false;
+	}
+
+	// the newest block is the most likely to have room
+	for (size_t i = blocks.size(); i-- > 0;)
+	{
+		if (allocateInBlock(i, size, slice))
+		{
+			return true;
+		}
+	}
+
+	addBlock();
+
+	if (!allocateInBlock(blocks.size() - 1, size, slice))
+	{
+		throw std::runtime_error("failed to allocate buffer slice");
+	}
+
+	return true;
+}
+
+bool BufferArena::allocateInBlock(size_t blockIndex, VkDeviceSize size, BufferSlice& slice)
+{
+	const Block& block = blocks.at(blockIndex);
+
+	VmaVirtualAllocationCreateInfo virtualAllocationInfo{};
+	virtualAllocationInfo.size = size;
+	virtualAllocationInfo.alignment = alignment;
+
+	VkDeviceSize offset = 0;
+	if (vmaVirtualAllocate(block.virtualBlock, &virtualAllocationInfo, &slice.virtualAllocation, &offset) != VK_SUCCESS)
+	{
+		return false;
+	}
+
+	slice.block = blockIndex;
+	slice.buffer = block.buffer;
+	slice.allocation = block.allocation;
+	slice.offset = offset;
+	slice.mappedData = block.mappedData != nullptr ? static_cast<uint8_t*>(block.mappedData) + offset : nullptr;
+	return true;
+}
+
+void BufferArena::free(const BufferSlice& slice)
+{
+	vmaVirtualFree(blocks.at(slice.block).virtualBlock, slice.virtualAllocation);
+}
+
+size_t BufferArena::getNumBlocks() const
+{
+	return blocks.size();
+}
+
+void BufferArena::addBlock()
+{
+	VkBufferCreateInfo bufferInfo{};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = BLOCK_SIZE;
+	bufferInfo.usage = usage;
+	bufferInfo.sharingMode = queueFamilyIndices.size() > 1 ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE;
+	bufferInfo.queueFamilyIndexCount = static_cast<uint32_t>(queueFamilyIndices.size());
+	bufferInfo.pQueueFamilyIndices = queueFamilyIndices.data();
+
+	Block block{};
+	VmaAllocationInfo allocationResult{};
+	if (vmaCreateBuffer(allocator, &bufferInfo, &allocationInfo, &block.buffer, &block.allocation, &allocationResult) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create buffer arena block");
+	}
+
+	// a block may have fallen back to memory the host can't see, whose slices are written through staging
+	VkMemoryPropertyFlags memoryProperties = 0;
+	vmaGetAllocationMemoryProperties(allocator, block.allocation, &memoryProperties);
+	block.mappedData = (memoryProperties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) ? allocationResult.pMappedData : nullptr;
+
+	VmaVirtualBlockCreateInfo virtualBlockInfo{};
+	virtualBlockInfo.size = BLOCK_SIZE;
+	if (vmaCreateVirtualBlock(&virtualBlockInfo, &block.virtualBlock) != VK_SUCCESS)
+	{
+		vmaDestroyBuffer(allocator, block.buffer, block.allocation);
+		throw std::runtime_error("failed to create buffer arena block");
+	}
+
+	blocks.push_back(block);
+}
\ No newline at end of file
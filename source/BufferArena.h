@@ -0,0 +1,110 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+#include <vk_mem_alloc.h>
+#include <vector>
+
+/**
+* @brief Part of a VkBuffer handed out by a BufferArena.
+*/
+struct BufferSlice
+{
+	/// buffer the slice is part of
+	VkBuffer buffer = VK_NULL_HANDLE;
+	/// allocation backing all of buffer
+	VmaAllocation allocation = VK_NULL_HANDLE;
+	/// offset of the slice within buffer in bytes
+	VkDeviceSize offset = 0;
+	/// start of the slice in host memory. nullptr if the memory isn't host visible
+	void* mappedData = nullptr;
+
+	// identifies the slice within its arena for freeing
+	size_t block = 0;
+	VmaVirtualAllocation virtualAllocation = VK_NULL_HANDLE;
+};
+
+/**
+* @brief Hands out slices of large VkBuffers sharing usage and memory placement, so small Buffers don't need a VkBuffer and allocation each.
+*
+* Slices are placed by a TLSF sub-allocator per block. Blocks are added as they fill up and live as long as the arena.
+*/
+class BufferArena
+{
+public:
+
+	/**
+	* @brief size of every block in bytes
+	*/
+	static constexpr VkDeviceSize BLOCK_SIZE = 32 * 1024 * 1024;
+
+	/**
+	* @brief largest slice handed out in bytes. Larger Buffers get an allocation of their own, so one doesn't fill up a block
+	*/
+	static constexpr VkDeviceSize MAX_SLICE_SIZE = BLOCK_SIZE / 8;
+
+	/**
+	* @brief Creates an empty BufferArena. Blocks are created once slices are allocated.
+	*
+	* @param allocator allocator of the blocks
+	* @param usage usage of every block
+	* @param queueFamilyIndices queue families the blocks are shared between. Concurrent sharing is used if there are several
+	* @param allocationInfo placement of every block
+	* @param alignment alignment of slice offsets
+	*/
+	BufferArena(VmaAllocator allocator, VkBufferUsageFlags usage, const std::vector<uint32_t>& queueFamilyIndices, const VmaAllocationCreateInfo& allocationInfo, VkDeviceSize alignment);
+
+	/**
+	* @brief Destroys all blocks. Slices must not be used afterwards.
+	*/
+	~BufferArena();
+
+	BufferArena(const BufferArena&) = delete;
+	BufferArena& operator=(const BufferArena&) = delete;
+
+	/**
+	* @brief Allocates a slice, adding a block if no block has room.
+	*
+	* @param size size of the slice in bytes
+	* @param slice set to the allocated slice
+	* @return false if size exceeds MAX_SLICE_SIZE, in which case nothing is allocated
+	*/
+	bool allocate(VkDeviceSize size, BufferSlice& slice);
+
+	/**
+	* @brief Returns a slice to the arena. The GPU must not use it anymore.
+	*
+	* @param slice slice returned by allocate
+	*/
+	void free(const BufferSlice& slice);
+
+	/**
+	* @brief Returns the number of VkBuffers the slices are placed in.
+	*
+	* @return number of blocks
+	*/
+	size_t getNumBlocks() const;
+
+private:
+
+	struct Block
+	{
+		VkBuffer buffer;
+		VmaAllocation allocation;
+		VmaVirtualBlock virtualBlock;
+
+		// start of the block in host memory. nullptr if it isn't host visible
+		void* mappedData;
+	};
+
+	VmaAllocator allocator;
+	VkBufferUsageFlags usage;
+	std::vector<uint32_t> queueFamilyIndices;
+	VmaAllocationCreateInfo allocationInfo;
+	VkDeviceSize alignment;
+
+	std::vector<Block> blocks;
+
+	void addBlock();
+
+	bool allocateInBlock(size_t blockIndex, VkDeviceSize size, BufferSlice& slice);
+};
\ No newline at end of file
@@ -5,17 +5,21 @@ ClearPass::ClearPass(VulkanCore& vulkanCoreSupport, Image& image) : Pass(vulkanC
 
 }
 
-void ClearPass::prepareExecution(std::function<void(VkCommandBuffer, Pass*)> insertBarriers)
+Image& ClearPass::getImage()
 {
-	Pass::prepareExecution(insertBarriers);
-	recordCommandBuffer(insertBarriers);
+	return image;
 }
 
-void ClearPass::recordCommandBuffer(std::function<void(VkCommandBuffer, Pass*)> insertBarriers)
+const VkClearColorValue& ClearPass::getClearColor() const
 {
-	startCommandBufferRecording(insertBarriers);
+	return clearColor;
+}
+
+void ClearPass::recordCommandBuffer(std::function<void(VkCommandBuffer, Pass*)> insertBarriers, uint32_t frameSlot)
+{
+	startCommandBufferRecording(insertBarriers, frameSlot);
 
-	VkClearColorValue clearColorValue{ 0, 0, 0, 0};
+	VkCommandBuffer commandBuffer = commandBuffers.at(frameSlot);
 
 	VkImageSubresourceRange range{};
 	range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -24,9 +28,7 @@ void ClearPass::recordCommandBuffer(std::function<void(VkCommandBuffer, Pass*)>
 	range.baseArrayLayer = 0;
 	range.layerCount = 1;
 
-	image.prepareForInitialAccess(commandBuffer, AccessSpecifier{ AccessSpecifier::OPERATION::CLEAR_OUTSIDE_RENDER_PASS, AccessSpecifier::STAGE::TRANSFER });
-
-	vkCmdClearColorImage(commandBuffer, image.getImage(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &clearColorValue, 1, &range);
+	vkCmdClearColorImage(commandBuffer, image.getImage(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &clearColor, 1, &range);
 
-	endCommandBufferRecording();
+	endCommandBufferRecording(frameSlot);
 }
\ No newline at end of file
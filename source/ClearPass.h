@@ -16,10 +16,24 @@ public:
 	*/
 	ClearPass(VulkanCore& vulkanCoreSupport, Image& image);
 
-	void prepareExecution(std::function<void(VkCommandBuffer, Pass*)> insertBarriers) override;
+	/**
+	* @brief Returns the Image this ClearPass clears.
+	* 
+	* @return cleared Image
+	*/
+	Image& getImage();
+
+	/**
+	* @brief Returns the color the Image is cleared to.
+	* 
+	* @return clear color
+	*/
+	const VkClearColorValue& getClearColor() const;
+
 
 private:
 	Image& image;
+	VkClearColorValue clearColor{ 0, 0, 0, 0 };
 
-	void recordCommandBuffer(std::function<void(VkCommandBuffer, Pass*)> insertBarriers) override;
+	void recordCommandBuffer(std::function<void(VkCommandBuffer, Pass*)> insertBarriers, uint32_t frameSlot) override;
 };
\ No newline at end of file
@@ -1,6 +1,6 @@
 #include "ComputePass.h"
 
-ComputePass::ComputePass(VulkanCore& vulkanCoreSupport, std::vector<ResourceShaderInterface> resources, const std::string& computeShaderPath) : PipelinePass(vulkanCoreSupport, resources), computeShader(vulkanCoreSupport, computeShaderPath)
+ComputePass::ComputePass(VulkanCore& vulkanCoreSupport, std::vector<ResourceShaderInterface> resources, const std::string& computeShaderPath, VulkanCore::QUEUE queue, const std::vector<VkPushConstantRange>& pushConstantRanges) : PipelinePass(vulkanCoreSupport, resources, pushConstantRanges), computeShader(vulkanCoreSupport, computeShaderPath), queue(vulkanCoreSupport.hasAsyncCompute() ? queue : VulkanCore::QUEUE::GRAPHICS)
 {
 }
 
@@ -8,11 +8,14 @@ ComputePass::~ComputePass()
 {
 }
 
-void ComputePass::prepareExecution(std::function<void(VkCommandBuffer, Pass*)> insertBarriers)
+void ComputePass::createExecutionObjects()
 {
-	PipelinePass::prepareExecution(insertBarriers);
 	createPipeline();
-	recordCommandBuffer(insertBarriers);
+}
+
+VulkanCore::QUEUE ComputePass::getQueue() const
+{
+	return queue;
 }
 
 void ComputePass::createPipeline()
@@ -35,21 +38,25 @@ void ComputePass::createPipeline()
 	createInfo.basePipelineHandle = VK_NULL_HANDLE;
 	createInfo.basePipelineIndex = 0;
 
-	if (vkCreateComputePipelines(getVulkanCoreSupport().getDevice(), VK_NULL_HANDLE, 1, &createInfo, VK_NULL_HANDLE, &pipeline) != VK_SUCCESS)
-	{
-		throw std::runtime_error("failed to create compute pass");
-	}
+	getVulkanCoreSupport().createComputePipeline(createInfo, pipeline);
 }
 
-void ComputePass::recordCommandBuffer(std::function<void(VkCommandBuffer, Pass*)> insertBarriers)
+void ComputePass::recordCommandBuffer(std::function<void(VkCommandBuffer, Pass*)> insertBarriers, uint32_t frameSlot)
 {
-	startCommandBufferRecording(insertBarriers);
+	startCommandBufferRecording(insertBarriers, frameSlot);
+
+	VkCommandBuffer commandBuffer = commandBuffers.at(frameSlot);
 
 	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
 
-	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+	recordPushConstants(commandBuffer);
+
+	std::vector<uint32_t> dynamicOffsets;
+	getDynamicOffsets(frameSlot, dynamicOffsets);
+
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSets.at(frameSlot), static_cast<uint32_t>(dynamicOffsets.size()), dynamicOffsets.data());
 
 	vkCmdDispatch(commandBuffer, getVulkanCoreSupport().getRenderResolution().width / 16 + 1, getVulkanCoreSupport().getRenderResolution().height / 16 + 1, 1);
 
-	endCommandBufferRecording();
+	endCommandBufferRecording(frameSlot);
 }
\ No newline at end of file
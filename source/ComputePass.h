@@ -16,17 +16,24 @@ public:
 	* 
 	* @param resources what resources the pass will use and how
 	* @param computeShaderPath location of shader code
+	* @param queue queue to execute on. ASYNC_COMPUTE lets the pass run alongside graphics work, e.g. the next frame's draws, where the device supports it
+	* @param pushConstantRanges push constant ranges the shader declares
 	*/
-	ComputePass(VulkanCore& vulkanCoreSupport, std::vector<ResourceShaderInterface> resources, const std::string& computeShaderPath);
+	ComputePass(VulkanCore& vulkanCoreSupport, std::vector<ResourceShaderInterface> resources, const std::string& computeShaderPath, VulkanCore::QUEUE queue = VulkanCore::QUEUE::GRAPHICS, const std::vector<VkPushConstantRange>& pushConstantRanges = {});
 
 	~ComputePass();
 
-	void prepareExecution(std::function<void(VkCommandBuffer, Pass*)> insertBarriers) override;
+	void createExecutionObjects() override;
+
+	VulkanCore::QUEUE getQueue() const override;
 
 private:
 	Shader computeShader;
 
+	// GRAPHICS if the device has no compute-only queue
+	VulkanCore::QUEUE queue;
+
 	void createPipeline() override;
 
-	void recordCommandBuffer(std::function<void(VkCommandBuffer, Pass*)> insertBarriers);
+	void recordCommandBuffer(std::function<void(VkCommandBuffer, Pass*)> insertBarriers, uint32_t frameSlot);
 };
\ No newline at end of file
@@ -2,8 +2,10 @@
 
 #include <array>
 #include <fstream>
+#include <set>
+#include <unordered_map>
 
-DrawPass::DrawPass(VulkanCore& vulkanCoreSupport, std::vector<ResourceShaderInterface> resources, const std::string& vertexShaderPath, const std::string& fragmentShaderPath, const GeometryContainer& mesh) : PipelinePass(vulkanCoreSupport, resources), mesh(mesh), vertexShader(vulkanCoreSupport, vertexShaderPath), fragmentShader(vulkanCoreSupport, fragmentShaderPath)
+DrawPass::DrawPass(VulkanCore& vulkanCoreSupport, std::vector<ResourceShaderInterface> resources, const std::string& vertexShaderPath, const std::string& fragmentShaderPath, const GeometryContainer& mesh, const std::vector<VkPushConstantRange>& pushConstantRanges) : PipelinePass(vulkanCoreSupport, resources, pushConstantRanges), mesh(mesh), vertexShader(vulkanCoreSupport, vertexShaderPath), fragmentShader(vulkanCoreSupport, fragmentShaderPath), subpassChain{ this }
 {
 	// separate output attachments now for easy access
 	for (const ResourceShaderInterface& resource : resources)
@@ -13,6 +15,10 @@ DrawPass::DrawPass(VulkanCore& vulkanCoreSupport, std::vector<ResourceShaderInte
 		{
 			outputAttachments.push_back(resource);
 		}
+		else if (resource.resource.accessSpecifier.operation == AccessSpecifier::OPERATION::INPUT_ATTACHMENT)
+		{
+			inputAttachments.push_back(resource);
+		}
 	}
 
 }
@@ -23,13 +29,25 @@ DrawPass::~DrawPass()
 	vkDestroyFramebuffer(getVulkanCoreSupport().getDevice(), frameBuffer, nullptr);
 }
 
-void DrawPass::prepareExecution(std::function<void(VkCommandBuffer, Pass*)> insertBarriers)
+void DrawPass::createExecutionObjects()
 {
-	PipelinePass::prepareExecution(insertBarriers);
+	// the first subpass creates the objects of the whole chain, since the pipelines depend on its render pass
+	if (subpassIndex > 0)
+	{
+		return;
+	}
+
 	createRenderPass();
 	createFrameBuffer();
-	createPipeline();
-	recordCommandBuffer(insertBarriers);
+	for (DrawPass* subpass : subpassChain)
+	{
+		subpass->createPipeline();
+	}
+}
+
+Pass* DrawPass::getRecordingPass()
+{
+	return subpassChain.front();
 }
 
 inline bool isColorAttachment(ResourceAccessSpecifier access)
@@ -41,46 +59,241 @@ inline bool isColorAttachment(ResourceShaderInterface access)
 	return isColorAttachment(access.resource);
 }
 
+inline bool isAttachmentOutput(ResourceAccessSpecifier access)
+{
+	return isColorAttachment(access) || access.accessSpecifier.operation == AccessSpecifier::OPERATION::DEPTH_BUFFER;
+}
+
+inline bool isInputAttachment(ResourceAccessSpecifier access)
+{
+	return access.accessSpecifier.operation == AccessSpecifier::OPERATION::INPUT_ATTACHMENT;
+}
+
+std::vector<ResourceShaderInterface> DrawPass::getAttachments() const
+{
+	std::vector<ResourceShaderInterface> attachments = outputAttachments;
+	attachments.insert(attachments.end(), inputAttachments.begin(), inputAttachments.end());
+	return attachments;
+}
+
+bool DrawPass::canMergeSubpass(const std::vector<DrawPass*>& chain, const DrawPass& pass)
+{
+	if (pass.inputAttachments.empty())
+	{
+		return false;
+	}
+
+	// a subpass only sees the pixel it shades, so every attachment has to cover the same area
+	std::vector<ResourceShaderInterface> attachments = pass.getAttachments();
+	for (const DrawPass* subpass : chain)
+	{
+		std::vector<ResourceShaderInterface> subpassAttachments = subpass->getAttachments();
+		attachments.insert(attachments.end(), subpassAttachments.begin(), subpassAttachments.end());
+	}
+
+	VkExtent2D extent = static_cast<Image*>(attachments.front().resource.resource)->getExtent();
+	for (const ResourceShaderInterface& attachment : attachments)
+	{
+		VkExtent2D attachmentExtent = static_cast<Image*>(attachment.resource.resource)->getExtent();
+		if (attachmentExtent.width == 0 || attachmentExtent.width != extent.width || attachmentExtent.height != extent.height)
+		{
+			return false;
+		}
+	}
+
+	std::vector<ResourceAccessSpecifier> accesses;
+	pass.getResources(accesses);
+
+	bool readsChainAttachment = false;
+	for (const DrawPass* subpass : chain)
+	{
+		std::vector<ResourceAccessSpecifier> subpassAccesses;
+		subpass->getResources(subpassAccesses);
+
+		for (const ResourceAccessSpecifier& access : accesses)
+		{
+			for (const ResourceAccessSpecifier& subpassAccess : subpassAccesses)
+			{
+				if (access.resource != subpassAccess.resource)
+				{
+					continue;
+				}
+
+				bool readsAttachment = isAttachmentOutput(subpassAccess) && isInputAttachment(access);
+				bool writesAttachmentInPlace = isAttachmentOutput(subpassAccess) && access.accessSpecifier.operation == subpassAccess.accessSpecifier.operation;
+				bool identicalReads = !access.accessSpecifier.isWriteAccess()
+					&& access.accessSpecifier.operation == subpassAccess.accessSpecifier.operation
+					&& access.accessSpecifier.stage == subpassAccess.accessSpecifier.stage;
+
+				// a clear can only happen when the render pass begins
+				bool clearsAttachment = pass.attachmentClearColors.count(access.resource) > 0;
+
+				if (clearsAttachment || (!readsAttachment && !writesAttachmentInPlace && !identicalReads))
+				{
+					return false;
+				}
+
+				readsChainAttachment = readsChainAttachment || readsAttachment;
+			}
+		}
+	}
+
+	return readsChainAttachment;
+}
+
+void DrawPass::clearAttachment(const Image& image, VkClearColorValue color)
+{
+	attachmentClearColors[&image] = color;
+}
+
+void DrawPass::mergeSubpasses(const std::vector<DrawPass*>& chain)
+{
+	for (uint32_t i = 0; i < chain.size(); i++)
+	{
+		chain.at(i)->subpassChain = chain;
+		chain.at(i)->subpassIndex = i;
+	}
+}
+
 void DrawPass::createRenderPass()
 {
+	struct SubpassReferences
+	{
+		std::vector<VkAttachmentReference> colorAttachments;
+		std::vector<VkAttachmentReference> inputAttachments;
+		std::vector<VkAttachmentReference> depthAttachment;
+		std::vector<uint32_t> preservedAttachments;
+	};
+
+	std::vector<SubpassReferences> subpassReferences(subpassChain.size());
 	std::vector<VkAttachmentDescription> attachmentDescriptions;
-	std::vector<VkAttachmentReference> colorAttachmentReferences;
-	VkAttachmentReference depthAttachmentReference;
+	std::unordered_map<Image*, uint32_t> attachmentIndices;
 
-	for (uint32_t i = 0; i < outputAttachments.size(); i++)
-	{
-		VkAttachmentDescription description;
-		VkAttachmentReference reference;
+	// subpasses each attachment is used in
+	std::vector<std::set<uint32_t>> attachmentSubpasses;
 
-		static_cast<Image*>(outputAttachments.at(i).resource.resource)->getAttachmentDescription(outputAttachments.at(i).resource.accessSpecifier, i, description, reference, outputAttachments.at(i).blendEnabled);
+	attachmentImages.clear();
+	clearValues.clear();
 
-		attachmentDescriptions.push_back(description);
-		if (isColorAttachment(outputAttachments.at(i)))
+	for (uint32_t subpass = 0; subpass < subpassChain.size(); subpass++)
+	{
+		DrawPass* drawPass = subpassChain.at(subpass);
+		for (const ResourceShaderInterface& attachment : drawPass->getAttachments())
 		{
-			colorAttachmentReferences.push_back(reference);
+			Image* image = static_cast<Image*>(attachment.resource.resource);
+
+			// blending and input attachments read the previous content, unless nothing was written before or it's cleared. Content nothing reads afterwards isn't stored
+			ResourceContentUse contentUse = drawPass->getContentUse(image);
+			auto clearColor = drawPass->attachmentClearColors.find(image);
+			bool cleared = clearColor != drawPass->attachmentClearColors.end();
+			bool loadContent = isInputAttachment(attachment.resource) || (attachment.blendEnabled && contentUse.previousContentDefined && !cleared);
+
+			auto attachmentIndex = attachmentIndices.emplace(image, static_cast<uint32_t>(attachmentDescriptions.size()));
+
+			VkAttachmentDescription description;
+			VkAttachmentReference reference;
+			image->getAttachmentDescription(attachment.resource.accessSpecifier, attachmentIndex.first->second, description, reference, loadContent, contentUse.contentUsedLater);
+
+			if (attachmentIndex.second)
+			{
+				attachmentDescriptions.push_back(description);
+				attachmentSubpasses.push_back({});
+				attachmentImages.push_back(image);
+
+				VkClearValue clearValue{};
+				if (attachment.resource.accessSpecifier.operation == AccessSpecifier::OPERATION::DEPTH_BUFFER)
+				{
+					clearValue.depthStencil = { 1.0f, 0 };
+				}
+				else if (cleared)
+				{
+					clearValue.color = clearColor->second;
+				}
+				else
+				{
+					clearValue.color = { 0.0f, 0.0f, 0.0f, 0.0f };
+				}
+				clearValues.push_back(clearValue);
+			}
+			else
+			{
+				// the first subpass using an attachment decides how it's loaded, the last how it's stored
+				attachmentDescriptions.at(attachmentIndex.first->second).storeOp = description.storeOp;
+				attachmentDescriptions.at(attachmentIndex.first->second).finalLayout = description.finalLayout;
+			}
+			attachmentSubpasses.at(attachmentIndex.first->second).insert(subpass);
+
+			if (isColorAttachment(attachment))
+			{
+				subpassReferences.at(subpass).colorAttachments.push_back(reference);
+			}
+			else if (isInputAttachment(attachment.resource))
+			{
+				subpassReferences.at(subpass).inputAttachments.push_back(reference);
+			}
+			else
+			{
+				subpassReferences.at(subpass).depthAttachment.push_back(reference);
+			}
 		}
-		else
+	}
+
+	// attachments used before and after a subpass that doesn't use them must be preserved through it
+	for (uint32_t attachment = 0; attachment < attachmentSubpasses.size(); attachment++)
+	{
+		const std::set<uint32_t>& subpasses = attachmentSubpasses.at(attachment);
+		for (uint32_t subpass = *subpasses.begin() + 1; subpass < *subpasses.rbegin(); subpass++)
 		{
-			depthAttachmentReference = reference;
+			if (subpasses.count(subpass) == 0)
+			{
+				subpassReferences.at(subpass).preservedAttachments.push_back(attachment);
+			}
 		}
 	}
-	
-	VkSubpassDescription subpass{};
-	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-	subpass.colorAttachmentCount = static_cast<uint32_t>(colorAttachmentReferences.size());
-	subpass.pColorAttachments = colorAttachmentReferences.data();
-	// TODO handle the case of a pass without a depth attachment
-	subpass.pDepthStencilAttachment = &depthAttachmentReference;
+
+	std::vector<VkSubpassDescription> subpassDescriptions;
+	for (const SubpassReferences& references : subpassReferences)
+	{
+		VkSubpassDescription subpass{};
+		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpass.colorAttachmentCount = static_cast<uint32_t>(references.colorAttachments.size());
+		subpass.pColorAttachments = references.colorAttachments.data();
+		subpass.inputAttachmentCount = static_cast<uint32_t>(references.inputAttachments.size());
+		subpass.pInputAttachments = references.inputAttachments.data();
+		subpass.pDepthStencilAttachment = references.depthAttachment.empty() ? nullptr : references.depthAttachment.data();
+		subpass.preserveAttachmentCount = static_cast<uint32_t>(references.preservedAttachments.size());
+		subpass.pPreserveAttachments = references.preservedAttachments.data();
+
+		subpassDescriptions.push_back(subpass);
+	}
+
+	// each subpass reads the pixel the previous ones wrote, so the dependencies between them are framebuffer-local
+	std::vector<VkSubpassDependency> dependencies;
+	for (uint32_t subpass = 1; subpass < subpassChain.size(); subpass++)
+	{
+		VkSubpassDependency dependency{};
+		dependency.srcSubpass = subpass - 1;
+		dependency.dstSubpass = subpass;
+		dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		dependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		dependency.dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		dependency.dstAccessMask = VK_ACCESS_INPUT_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+			| VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		dependency.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+		dependencies.push_back(dependency);
+	}
 
 	VkRenderPassCreateInfo renderPassInfo{};
 	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
 	renderPassInfo.attachmentCount = static_cast<uint32_t>(attachmentDescriptions.size());
 	renderPassInfo.pAttachments = attachmentDescriptions.data();
-	renderPassInfo.subpassCount = 1;
-	renderPassInfo.pSubpasses = &subpass;
+	renderPassInfo.subpassCount = static_cast<uint32_t>(subpassDescriptions.size());
+	renderPassInfo.pSubpasses = subpassDescriptions.data();
 
-	renderPassInfo.dependencyCount = 0;
-	renderPassInfo.pDependencies = VK_NULL_HANDLE;
+	// barriers recorded before the render pass order it with earlier work
+	renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+	renderPassInfo.pDependencies = dependencies.data();
 
 	if (vkCreateRenderPass(getVulkanCoreSupport().getDevice(), &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS)
 	{
@@ -93,18 +306,18 @@ void DrawPass::createRenderPass()
 void DrawPass::createFrameBuffer()
 {
 	std::vector<VkImageView> attachmentViews;
-	for (const auto& outputAttachment : outputAttachments)
+	for (Image* attachmentImage : attachmentImages)
 	{
-		attachmentViews.push_back(static_cast<Image*>(outputAttachment.resource.resource)->getImageView());
+		attachmentViews.push_back(attachmentImage->getImageView());
 	}
 
 	VkFramebufferCreateInfo framebufferInfo{};
 	framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
 	framebufferInfo.renderPass = renderPass;
-	framebufferInfo.attachmentCount = static_cast<uint32_t>(outputAttachments.size());
+	framebufferInfo.attachmentCount = static_cast<uint32_t>(attachmentViews.size());
 	framebufferInfo.pAttachments = attachmentViews.data();
-	framebufferInfo.width = static_cast<Image*>(outputAttachments.at(0).resource.resource)->getExtent().width;
-	framebufferInfo.height = static_cast<Image*>(outputAttachments.at(0).resource.resource)->getExtent().height;
+	framebufferInfo.width = attachmentImages.at(0)->getExtent().width;
+	framebufferInfo.height = attachmentImages.at(0)->getExtent().height;
 	framebufferInfo.layers = 1;
 
 	if (vkCreateFramebuffer(getVulkanCoreSupport().getDevice(), &framebufferInfo, nullptr, &frameBuffer) != VK_SUCCESS)
@@ -262,21 +475,20 @@ void DrawPass::createPipeline()
 
 	pipelineInfo.layout = pipelineLayout;
 
-	pipelineInfo.renderPass = renderPass;
-	pipelineInfo.subpass = 0;
+	pipelineInfo.renderPass = subpassChain.front()->renderPass;
+	pipelineInfo.subpass = subpassIndex;
 
 	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 	pipelineInfo.basePipelineIndex = -1;
 
-	if (vkCreateGraphicsPipelines(getVulkanCoreSupport().getDevice(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS)
-	{
-		throw std::runtime_error("failed to create graphics pipeline");
-	}
+	getVulkanCoreSupport().createGraphicsPipeline(pipelineInfo, pipeline);
 }
 
-void DrawPass::recordCommandBuffer(std::function<void(VkCommandBuffer, Pass*)> insertBarriers)
+void DrawPass::recordCommandBuffer(std::function<void(VkCommandBuffer, Pass*)> insertBarriers, uint32_t frameSlot)
 {
-	startCommandBufferRecording(insertBarriers);
+	startCommandBufferRecording(insertBarriers, frameSlot);
+
+	VkCommandBuffer commandBuffer = commandBuffers.at(frameSlot);
 
 	VkRenderPassBeginInfo renderPassInfo{};
 	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
@@ -284,45 +496,44 @@ void DrawPass::recordCommandBuffer(std::function<void(VkCommandBuffer, Pass*)> i
 	renderPassInfo.framebuffer = frameBuffer;
 	renderPassInfo.renderArea.offset = { 0,0 };
 	renderPassInfo.renderArea.extent = getVulkanCoreSupport().getRenderResolution();
+	renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+	renderPassInfo.pClearValues = clearValues.data();
 
-	std::vector<VkClearValue> clearValues;
-	for (const ResourceShaderInterface& outputAttachment : outputAttachments)
-	{
-		VkClearValue clearValue{};
+	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-		if (isColorAttachment(outputAttachment))
-		{
-			clearValue.color = { 0.0f, 0.0f, 0.0f, 0.0f };
-		}
-		else // is depth attachment
+	for (DrawPass* subpass : subpassChain)
+	{
+		if (subpass != this)
 		{
-			clearValue.depthStencil = { 1.0f, 0 };
+			vkCmdNextSubpass(commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
 		}
 
-		clearValues.push_back(clearValue);
+		subpass->recordSubpass(commandBuffer, frameSlot);
 	}
 
-	renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-	renderPassInfo.pClearValues = clearValues.data();
-
-	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+	vkCmdEndRenderPass(commandBuffer);
 
+	endCommandBufferRecording(frameSlot);
+}
 
+void DrawPass::recordSubpass(VkCommandBuffer commandBuffer, uint32_t frameSlot)
+{
 	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
 
-	VkBuffer vertexBuffers[] = { mesh.getVertexBuffer().getBufferObject() };
-	VkDeviceSize offsets[] = { 0 };
+	recordPushConstants(commandBuffer);
+
+	VkBuffer vertexBuffers[] = { mesh.getVertexBuffer().getBufferObject(frameSlot) };
+	VkDeviceSize offsets[] = { mesh.getVertexBuffer().getOffset(frameSlot) };
 	vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
 
 
 
-	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+	std::vector<uint32_t> dynamicOffsets;
+	getDynamicOffsets(frameSlot, dynamicOffsets);
 
-	vkCmdBindIndexBuffer(commandBuffer, mesh.getIndexBuffer().getBufferObject(), 0, mesh.getIndexType());
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets.at(frameSlot), static_cast<uint32_t>(dynamicOffsets.size()), dynamicOffsets.data());
 
-	vkCmdDrawIndexed(commandBuffer, mesh.getNumIndices(), 1, 0, 0, 0);
+	vkCmdBindIndexBuffer(commandBuffer, mesh.getIndexBuffer().getBufferObject(frameSlot), mesh.getIndexBuffer().getOffset(frameSlot), mesh.getIndexType());
 
-	vkCmdEndRenderPass(commandBuffer);
-
-	endCommandBufferRecording();
+	vkCmdDrawIndexed(commandBuffer, mesh.getNumIndices(), 1, 0, 0, 0);
 }
@@ -12,6 +12,8 @@
 
 /**
 * @brief Pass that executes a draw command on a Mesh, using user-supplied vertex and fragment shader code.
+* 
+* Resources accessed as INPUT_ATTACHMENT are bound in declaration order, matching input_attachment_index in the fragment shader. Consecutive DrawPasses reading each other's attachments that way may be merged into subpasses of one render pass, keeping the attachments in tile memory between them.
 */
 class DrawPass : public PipelinePass
 {
@@ -24,22 +26,65 @@ public:
 	* @param vertexShaderPath location of vertex shader code
 	* @param fragmentShaderPath location of fragment shader code
 	* @param mesh geometry to execute draw command on
+	* @param pushConstantRanges push constant ranges the shaders declare, with the stages reading each
 	*/
-	DrawPass(VulkanCore& vulkanCoreSupport, std::vector<ResourceShaderInterface> resources, const std::string& vertexShaderPath, const std::string& fragmentShaderPath, const GeometryContainer& mesh);
+	DrawPass(VulkanCore& vulkanCoreSupport, std::vector<ResourceShaderInterface> resources, const std::string& vertexShaderPath, const std::string& fragmentShaderPath, const GeometryContainer& mesh, const std::vector<VkPushConstantRange>& pushConstantRanges = {});
 	~DrawPass();
 
-	void prepareExecution(std::function<void(VkCommandBuffer, Pass*)> insertBarriers) override;
+	void createExecutionObjects() override;
+
+	Pass* getRecordingPass() override;
+
+	/**
+	* @brief Returns whether pass may execute as the subpass following chain in the same render pass.
+	* 
+	* pass must read an attachment chain writes as an input attachment. It may share no other resources with chain, except attachments it writes in place and reads identical to chain's. All attachments must have the same extent.
+	* 
+	* @param chain consecutive DrawPasses in execution order
+	* @param pass DrawPass executing directly after chain
+	* @return whether pass can be merged into chain
+	*/
+	static bool canMergeSubpass(const std::vector<DrawPass*>& chain, const DrawPass& pass);
+
+	/**
+	* @brief Merges consecutive DrawPasses into subpasses of one render pass, recorded into the command buffers of the first. Must be called before the passes are registered.
+	* 
+	* @param chain DrawPasses in execution order, each accepted by canMergeSubpass for the ones before it
+	*/
+	static void mergeSubpasses(const std::vector<DrawPass*>& chain);
+
+	/**
+	* @brief Clears a color attachment when the render pass begins, in place of a ClearPass executing right before this DrawPass. Must be called before createExecutionObjects.
+	* 
+	* @param image Image this DrawPass draws to as a color attachment
+	* @param color color to clear image to
+	*/
+	void clearAttachment(const Image& image, VkClearColorValue color);
 
 private:
 	const GeometryContainer& mesh;
 	Shader vertexShader;
 	Shader fragmentShader;
 	std::vector<ResourceShaderInterface> outputAttachments;
-	VkRenderPass renderPass;
-	VkFramebuffer frameBuffer;
+	std::vector<ResourceShaderInterface> inputAttachments;
+	VkRenderPass renderPass = VK_NULL_HANDLE;
+	VkFramebuffer frameBuffer = VK_NULL_HANDLE;
+
+	// DrawPasses executing as consecutive subpasses of the render pass of the first. Only this DrawPass unless merged
+	std::vector<DrawPass*> subpassChain;
+	uint32_t subpassIndex = 0;
+
+	// colors of attachments cleared in place of a ClearPass
+	std::unordered_map<const Resource*, VkClearColorValue> attachmentClearColors;
+
+	// Images attached to the render pass, in attachment order, and the values they're cleared to. Only used by the first DrawPass of subpassChain
+	std::vector<Image*> attachmentImages;
+	std::vector<VkClearValue> clearValues;
 
 	void createPipeline() override;
 	void createRenderPass();
 	void createFrameBuffer();
-	void recordCommandBuffer(std::function<void(VkCommandBuffer, Pass*)> insertBarriers) override;
+	void recordCommandBuffer(std::function<void(VkCommandBuffer, Pass*)> insertBarriers, uint32_t frameSlot) override;
+	void recordSubpass(VkCommandBuffer commandBuffer, uint32_t frameSlot);
+	std::vector<ResourceShaderInterface> getAttachments() const;
 };
\ No newline at end of file
@@ -118,10 +118,11 @@ private:
 	void init(VulkanCore& vulkanCoreSupport, const std::vector<VertexType>& vertices, const std::vector<IndexType>& indices)
 	{
 		VkDeviceSize vertexBufferSize = sizeof(VertexType) * vertices.size();
-		vertexBuffer = std::make_unique<Buffer>(vulkanCoreSupport, vertexBufferSize, AccessSpecifier::OPERATION::VERTEX_BUFFER, Resource::ACCESS_PROPERTY::GPU_PREFERRED, vertices.data());
+		// meshes are typically small, so they share buffer objects instead of taking two allocations each
+		vertexBuffer = std::make_unique<Buffer>(vulkanCoreSupport, vertexBufferSize, AccessSpecifier::OPERATION::VERTEX_BUFFER, Resource::ACCESS_PROPERTY::GPU_PREFERRED, vertices.data(), Buffer::UPDATE_FREQUENCY::STATIC, Buffer::ALLOCATION::SUBALLOCATED);
 
 		VkDeviceSize indexBufferSize = sizeof(IndexType) * indices.size();
-		indexBuffer = std::make_unique<Buffer>(vulkanCoreSupport, indexBufferSize, AccessSpecifier::OPERATION::INDEX_BUFFER, Resource::ACCESS_PROPERTY::GPU_PREFERRED, indices.data());
+		indexBuffer = std::make_unique<Buffer>(vulkanCoreSupport, indexBufferSize, AccessSpecifier::OPERATION::INDEX_BUFFER, Resource::ACCESS_PROPERTY::GPU_PREFERRED, indices.data(), Buffer::UPDATE_FREQUENCY::STATIC, Buffer::ALLOCATION::SUBALLOCATED);
 
 		bindingDescription = createBindingDescription(static_cast<int>(vertexBufferSize / vertices.size()));
 		attributeDescriptions = createAttributeDescription(static_cast<int>(vertexBufferSize / vertices.size() / sizeof(attributeType)));
@@ -1,6 +1,7 @@
 #include "Image.h"
 
 #include <iostream>
+#include <numeric>
 
 #include "PixelDataContainer.h"
 
@@ -9,6 +10,7 @@ const std::unordered_map<AccessSpecifier::OPERATION, VkImageLayout> Image::REQUI
 	{AccessSpecifier::OPERATION::NO_OPERATION, VK_IMAGE_LAYOUT_UNDEFINED},
 	{AccessSpecifier::OPERATION::COLOR_ATTACHMENT_OUTPUT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL},
 	{AccessSpecifier::OPERATION::COLOR_SAMPLER, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL},
+	{AccessSpecifier::OPERATION::INPUT_ATTACHMENT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL},
 	{AccessSpecifier::OPERATION::DEPTH_SAMPLER, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL},
 	{AccessSpecifier::OPERATION::TRANSFER_DESTINATION, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL},
 	{AccessSpecifier::OPERATION::TRANSFER_SOURCE, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL},
@@ -24,6 +26,7 @@ const std::unordered_map<AccessSpecifier::OPERATION, VkBufferUsageFlags> Image::
 	{AccessSpecifier::OPERATION::COLOR_ATTACHMENT_OUTPUT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT},
 	{AccessSpecifier::OPERATION::DEPTH_SAMPLER, VK_IMAGE_USAGE_SAMPLED_BIT},
 	{AccessSpecifier::OPERATION::COLOR_SAMPLER, VK_IMAGE_USAGE_SAMPLED_BIT},
+	{AccessSpecifier::OPERATION::INPUT_ATTACHMENT, VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT},
 	{AccessSpecifier::OPERATION::TRANSFER_SOURCE, VK_IMAGE_USAGE_TRANSFER_SRC_BIT},
 	{AccessSpecifier::OPERATION::TRANSFER_DESTINATION, VK_IMAGE_USAGE_TRANSFER_DST_BIT},
 	{AccessSpecifier::OPERATION::PREPARE_FOR_PRESENTATION, VK_IMAGE_USAGE_TRANSFER_SRC_BIT},
@@ -38,6 +41,7 @@ const std::unordered_map<AccessSpecifier::OPERATION, VkImageAspectFlags> Image::
 	{AccessSpecifier::OPERATION::COLOR_ATTACHMENT_OUTPUT, VK_IMAGE_ASPECT_COLOR_BIT},
 	{AccessSpecifier::OPERATION::DEPTH_SAMPLER, VK_IMAGE_ASPECT_DEPTH_BIT},
 	{AccessSpecifier::OPERATION::COLOR_SAMPLER, VK_IMAGE_ASPECT_COLOR_BIT},
+	{AccessSpecifier::OPERATION::INPUT_ATTACHMENT, VK_IMAGE_ASPECT_COLOR_BIT},
 	{AccessSpecifier::OPERATION::TRANSFER_SOURCE, VK_IMAGE_ASPECT_COLOR_BIT},
 	{AccessSpecifier::OPERATION::TRANSFER_DESTINATION, VK_IMAGE_ASPECT_COLOR_BIT},
 	{AccessSpecifier::OPERATION::PREPARE_FOR_PRESENTATION, VK_IMAGE_ASPECT_COLOR_BIT},
@@ -112,7 +116,11 @@ void Image::init(VkFormat format, VkImageUsageFlags usage, VkMemoryPropertyFlags
 	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
 	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 	imageInfo.usage = usage;
-	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	// resources used on several queues are shared concurrently instead of transferring ownership between them
+	std::vector<uint32_t> queueFamilyIndices = getVulkanCoreSupport().getResourceQueueFamilyIndices();
+	imageInfo.sharingMode = queueFamilyIndices.size() > 1 ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE;
+	imageInfo.queueFamilyIndexCount = static_cast<uint32_t>(queueFamilyIndices.size());
+	imageInfo.pQueueFamilyIndices = queueFamilyIndices.data();
 	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
 	imageInfo.flags = VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT;
 
@@ -136,13 +144,21 @@ void Image::initializeEmptyImage(VkExtent2D extent, VkFormat format, ACCESS_PROP
 	this->format = format;
 
 	VkImageUsageFlags useFlags = 0;
-	VkImageAspectFlags aspectFlags = 0;
+	aspectFlags = 0;
 	for (auto use : accessTypes)
 	{
 		useFlags |= USE_USAGE_FLAGS.at(use);
 		aspectFlags |= USE_ASPECT_FLAGS.at(use);
 	}
 
+	// a transient Image used only as an attachment never leaves tile memory on tiling GPUs
+	const VkImageUsageFlags attachmentUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+	if (lifetime == LIFETIME::TRANSIENT && (useFlags & ~attachmentUsage) == 0)
+	{
+		useFlags |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+	}
+	usageFlags = useFlags;
+
 
 	VkImageCreateInfo imageInfo{};
 	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -156,18 +172,31 @@ void Image::initializeEmptyImage(VkExtent2D extent, VkFormat format, ACCESS_PROP
 	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
 	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 	imageInfo.usage = useFlags;
-	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	// resources used on several queues are shared concurrently instead of transferring ownership between them
+	std::vector<uint32_t> queueFamilyIndices = getVulkanCoreSupport().getResourceQueueFamilyIndices();
+	imageInfo.sharingMode = queueFamilyIndices.size() > 1 ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE;
+	imageInfo.queueFamilyIndexCount = static_cast<uint32_t>(queueFamilyIndices.size());
+	imageInfo.pQueueFamilyIndices = queueFamilyIndices.data();
 	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
 	imageInfo.flags = VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT;
 
+	responsibleForImageDestruction = true;
+
+	// transient Images are bound to shared memory and get their view once the passes using them are known
+	if (lifetime == LIFETIME::TRANSIENT)
+	{
+		if (vkCreateImage(getVulkanCoreSupport().getDevice(), &imageInfo, nullptr, &image) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create image");
+		}
+		return;
+	}
+
 	VmaAllocationCreateInfo imageCreateInfo{};
 	imageCreateInfo.usage = VMA_MEMORY_USAGE_AUTO;
 
 	auto result = vmaCreateImage(getVulkanCoreSupport().getVmaAllocator(), &imageInfo, &imageCreateInfo, &image, &imageAllocation, nullptr);
 
-	// create image
-	responsibleForImageDestruction = true;
-
 	// create view
 	createImageView(image, format, aspectFlags, imageView, getVulkanCoreSupport().getDevice());
 
@@ -175,8 +204,11 @@ void Image::initializeEmptyImage(VkExtent2D extent, VkFormat format, ACCESS_PROP
 	createSampler(sampler, getVulkanCoreSupport().getDevice());
 }
 
-Image::Image(VulkanCore& vulkanCoreSupport, VkFormat format, VkExtent2D extent, ACCESS_PROPERTY accessProperty) : Resource(vulkanCoreSupport)
+Image::Image(VulkanCore& vulkanCoreSupport, VkFormat format, VkExtent2D extent, ACCESS_PROPERTY accessProperty, LIFETIME lifetime) : Resource(vulkanCoreSupport), lifetime(lifetime)
 {
+	// known before initialization so passes can be compared while compiling
+	this->extent = extent;
+
 	initializeFunction = [this, extent, format, accessProperty]()
 	{
 		initializeEmptyImage(extent, format, accessProperty);
@@ -186,17 +218,38 @@ Image::Image(VulkanCore& vulkanCoreSupport, VkFormat format, VkExtent2D extent,
 Image::Image(VulkanCore& vulkanCoreSupport, VkFormat format, const std::string& path, ACCESS_PROPERTY accessProperty) : Resource(vulkanCoreSupport)
 {
 
-	initializeFunction = [this, path, format, accessProperty]()
+	// decoding is the expensive part of loading a texture, and needs no GPU
+	loadFunction = [this, path]()
 	{
-		// read from texture file
-		PixelDataContainer pixels(path);
-
-		// Create temp stagingBuffer
-		Buffer stagingBuffer(getVulkanCoreSupport(), pixels.getSizeInBytes(), AccessSpecifier::OPERATION::TRANSFER_SOURCE, ACCESS_PROPERTY::CPU_PREFERRED, pixels.getData());
-
-		initializeEmptyImage(VkExtent2D{ static_cast<uint32_t>(pixels.getWidth()), static_cast<uint32_t>(pixels.getHeight()) }, format, accessProperty);
+		pixels = std::make_unique<PixelDataContainer>(path);
+	};
 
-		copyBufferToImage(stagingBuffer);
+	initializeFunction = [this, format, accessProperty]()
+	{
+		initializeEmptyImage(VkExtent2D{ static_cast<uint32_t>(pixels->getWidth()), static_cast<uint32_t>(pixels->getHeight()) }, format, accessProperty);
+
+		// copies to images need offsets that are multiples of the texel size and of 4, and prefer the device's optimal alignment
+		VkDeviceSize texelSize = static_cast<VkDeviceSize>(pixels->getSizeInBytes()) / (static_cast<VkDeviceSize>(pixels->getWidth()) * pixels->getHeight());
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(getVulkanCoreSupport().getPhysicalDevice(), &properties);
+		VkDeviceSize copyAlignment = std::lcm(std::lcm(texelSize, VkDeviceSize(4)), properties.limits.optimalBufferCopyOffsetAlignment);
+
+		// pixels are staged in the shared ring buffer unless they don't fit
+		StagingRegion stagingRegion;
+		if (getVulkanCoreSupport().stageUploadData(pixels->getSizeInBytes(), pixels->getData(), stagingRegion, copyAlignment))
+		{
+			copyToImage(stagingRegion.buffer, stagingRegion.offset, nullptr);
+		}
+		else
+		{
+			// Create temp stagingBuffer
+			auto stagingBuffer = std::make_shared<Buffer>(getVulkanCoreSupport(), pixels->getSizeInBytes(), AccessSpecifier::OPERATION::TRANSFER_SOURCE, ACCESS_PROPERTY::CPU_PREFERRED, pixels->getData());
+			stagingBuffer->initialize();
+
+			copyBufferToImage(stagingBuffer);
+		}
+
+		pixels.reset();
 	};
 }
 
@@ -226,15 +279,20 @@ Image::~Image()
 	}
 }
 
-void Image::copyBufferToImage(const Buffer& buffer)
+void Image::copyBufferToImage(std::shared_ptr<const Buffer> buffer)
 {
-	auto copyCommand = [&buffer, this](VkCommandBuffer commandBuffer)
+	copyToImage(buffer->getBufferObject(), buffer->getOffset(), [buffer]() {});
+}
+
+void Image::copyToImage(VkBuffer source, VkDeviceSize sourceOffset, std::function<void()> onComplete)
+{
+	auto copyCommand = [source, sourceOffset, this](VkCommandBuffer commandBuffer)
 	{
 		// We assume this is only called in constructors TODO
 		prepareForInitialAccess(commandBuffer, { AccessSpecifier::OPERATION::TRANSFER_DESTINATION, AccessSpecifier::STAGE::TRANSFER });
 
 		VkBufferImageCopy region{};
-		region.bufferOffset = 0;
+		region.bufferOffset = sourceOffset;
 		region.bufferRowLength = 0;
 		region.bufferImageHeight = 0;
 
@@ -250,11 +308,9 @@ void Image::copyBufferToImage(const Buffer& buffer)
 			1
 		};
 
-		VkBuffer b = buffer.getBufferObject();
-
 		vkCmdCopyBufferToImage(
 			commandBuffer,
-			buffer.getBufferObject(),
+			source,
 			image,
 			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
 			1,
@@ -262,6 +318,49 @@ void Image::copyBufferToImage(const Buffer& buffer)
 		);
 	};
 
+	uint64_t submission = getVulkanCoreSupport().executeUploadCommands(copyCommand, onComplete, getLastUseSubmission());
+	registerSubmission(submission, getVulkanCoreSupport().getFrameSlot());
+
+	// the copied texels stay in the transfer layout until the first frame transitions them
+	initialAccess = { AccessSpecifier::OPERATION::TRANSFER_DESTINATION, AccessSpecifier::STAGE::TRANSFER };
+}
+
+void Image::copyImageToBuffer(const Buffer& buffer, AccessSpecifier currentAccess)
+{
+	auto copyCommand = [&buffer, currentAccess, this](VkCommandBuffer commandBuffer)
+	{
+		AccessSpecifier transferAccess{ AccessSpecifier::OPERATION::TRANSFER_SOURCE, AccessSpecifier::STAGE::TRANSFER };
+		insertBarrier(commandBuffer, currentAccess, transferAccess);
+
+		VkBufferImageCopy region{};
+		region.bufferOffset = buffer.getOffset();
+		region.bufferRowLength = 0;
+		region.bufferImageHeight = 0;
+
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.mipLevel = 0;
+		region.imageSubresource.baseArrayLayer = 0;
+		region.imageSubresource.layerCount = 1;
+
+		region.imageOffset = { 0, 0, 0 };
+		region.imageExtent = {
+			extent.width,
+			extent.height,
+			1
+		};
+
+		vkCmdCopyImageToBuffer(
+			commandBuffer,
+			image,
+			VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			buffer.getBufferObject(),
+			1,
+			&region
+		);
+
+		insertBarrier(commandBuffer, transferAccess, currentAccess);
+	};
+
 	getVulkanCoreSupport().executeInstantCommands(copyCommand);
 }
 
@@ -274,7 +373,7 @@ void Image::createLayoutBinding(int index, AccessSpecifier access, VkDescriptorS
 	out.pImmutableSamplers = nullptr;
 }
 
-void Image::createDescriptorWrite(int index, AccessSpecifier access, const VkDescriptorSet& descriptorSet, VkWriteDescriptorSet& out) const
+void Image::createDescriptorWrite(int index, AccessSpecifier access, const VkDescriptorSet& descriptorSet, uint32_t frameSlot, VkWriteDescriptorSet& out) const
 {
 	VkDescriptorImageInfo samplerInfo{};
 	samplerInfo.imageLayout = REQUIRED_LAYOUTS.at(access.operation);
@@ -300,15 +399,21 @@ void Image::prepareForInitialAccess(VkCommandBuffer& commandBuffer, AccessSpecif
 	insertBarrier(commandBuffer, AccessSpecifier{ AccessSpecifier::OPERATION::NO_OPERATION, AccessSpecifier::STAGE::INITIAL }, currentAccess);
 }
 
-void Image::insertBarrier(VkCommandBuffer& commandBuffer, AccessSpecifier previousAccess, AccessSpecifier currentAccess)
+void Image::addBarrier(BarrierBatch& batch, const std::vector<AccessSpecifier>& previousAccesses, AccessSpecifier currentAccess, bool discardContent)
 {
-	VkImageLayout currentLayout = REQUIRED_LAYOUTS.at(previousAccess.operation);
+	// previous accesses share a layout, so any of them describes it
+	VkImageLayout currentLayout = discardContent ? VK_IMAGE_LAYOUT_UNDEFINED : REQUIRED_LAYOUTS.at(previousAccesses.front().operation);
 	VkImageLayout requiredLayout = REQUIRED_LAYOUTS.at(currentAccess.operation);
 
-	auto previousAccessMask = getAccessFlag(previousAccess);
-	auto currentAccessMask = getAccessFlag(currentAccess);
+	VkAccessFlags previousAccessMask = 0;
+	VkPipelineStageFlags previousStageMask = 0;
+	for (const AccessSpecifier& previousAccess : previousAccesses)
+	{
+		previousAccessMask |= getAccessFlag(previousAccess);
+		previousStageMask |= getPipelineStageFlag(previousAccess);
+	}
 
-	auto previousStageMask = getPipelineStageFlag(previousAccess);
+	auto currentAccessMask = getAccessFlag(currentAccess);
 	auto currentStageMask = getPipelineStageFlag(currentAccess);
 
 	VkImageMemoryBarrier barrier{};
@@ -326,20 +431,46 @@ void Image::insertBarrier(VkCommandBuffer& commandBuffer, AccessSpecifier previo
 	barrier.subresourceRange.baseArrayLayer = 0;
 	barrier.subresourceRange.layerCount = 1;
 
-	vkCmdPipelineBarrier(
-		commandBuffer,
-		previousStageMask, //VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-		currentStageMask, //VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-		0,
-		0, VK_NULL_HANDLE,
-		0, VK_NULL_HANDLE,
-		1, &barrier
-	);
-
-	currentLayout = requiredLayout;
+	batch.addImageBarrier(previousStageMask, currentStageMask, barrier);
+}
+
+bool Image::requiresLayoutTransition(const AccessSpecifier& previousAccess, const AccessSpecifier& currentAccess) const
+{
+	return REQUIRED_LAYOUTS.at(previousAccess.operation) != REQUIRED_LAYOUTS.at(currentAccess.operation);
+}
+
+bool Image::isTransient() const
+{
+	return lifetime == LIFETIME::TRANSIENT;
+}
+
+VkMemoryRequirements Image::getMemoryRequirements()
+{
+	VkMemoryRequirements memoryRequirements;
+	vkGetImageMemoryRequirements(getVulkanCoreSupport().getDevice(), image, &memoryRequirements);
+	return memoryRequirements;
+}
+
+void Image::bindMemory(VmaAllocation allocation, Image* precedingAlias)
+{
+	if (vmaBindImageMemory(getVulkanCoreSupport().getVmaAllocator(), allocation, image) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to bind image memory");
+	}
+
+	this->precedingAlias = precedingAlias;
+
+	// views can only be created for bound images
+	createImageView(image, format, aspectFlags, imageView, getVulkanCoreSupport().getDevice());
+	createSampler(sampler, getVulkanCoreSupport().getDevice());
+}
+
+Image* Image::getPrecedingAlias()
+{
+	return precedingAlias;
 }
 
-void Image::getAttachmentDescription(AccessSpecifier currentAccess, uint32_t attachmentNumber, VkAttachmentDescription& attachmentDescription, VkAttachmentReference& attachmentReference, bool blend)
+void Image::getAttachmentDescription(AccessSpecifier currentAccess, uint32_t attachmentNumber, VkAttachmentDescription& attachmentDescription, VkAttachmentReference& attachmentReference, bool loadContent, bool storeContent)
 {
 	VkImageLayout requiredLayout = REQUIRED_LAYOUTS.at(currentAccess.operation);
 
@@ -347,7 +478,7 @@ void Image::getAttachmentDescription(AccessSpecifier currentAccess, uint32_t att
 	attachmentDescription.format = format;
 	attachmentDescription.samples = VK_SAMPLE_COUNT_1_BIT;
 
-	if (!blend)
+	if (!loadContent)
 	{
 		attachmentDescription.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
 		attachmentDescription.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -358,7 +489,7 @@ void Image::getAttachmentDescription(AccessSpecifier currentAccess, uint32_t att
 		attachmentDescription.initialLayout = requiredLayout;
 	}
 	
-	attachmentDescription.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	attachmentDescription.storeOp = storeContent ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	attachmentDescription.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	attachmentDescription.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	
@@ -373,6 +504,11 @@ void Image::getAttachmentDescription(AccessSpecifier currentAccess, uint32_t att
 
 }
 
+bool Image::isTransientAttachment() const
+{
+	return (usageFlags & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT) != 0;
+}
+
 VkImage& Image::getImage()
 {
 	return image;
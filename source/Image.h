@@ -10,6 +10,8 @@
 #include "Resource.h"
 #include "ResourceAccessSpecifier.h"
 
+class PixelDataContainer;
+
 
 /**
 * @brief Representation of a GPU-accessible image.
@@ -18,14 +20,26 @@ class Image : public Resource
 {
 public:
 
+	/**
+	* @brief Indication of whether an Image's contents must survive from one frame to the next.
+	*/
+	enum LIFETIME
+	{
+		/// Contents persist between frames. The Image has memory of its own
+		PERSISTENT,
+		/// Contents are only valid from the first to the last access within a frame. The Image may share memory with other transient Images whose accesses don't overlap
+		TRANSIENT,
+	};
+
 	/**
 	* @brief Creates an empty image.
 	* 
 	* @param format format of image
 	* @param extent dimensions of image
 	* @param accessProperty memory location preference
+	* @param lifetime whether contents must survive between frames
 	*/
-	Image(VulkanCore& vulkanCoreSupport, VkFormat format, VkExtent2D extent, ACCESS_PROPERTY accessProperty);
+	Image(VulkanCore& vulkanCoreSupport, VkFormat format, VkExtent2D extent, ACCESS_PROPERTY accessProperty, LIFETIME lifetime = LIFETIME::PERSISTENT);
 
 	/**
 	* @brief Creates an Image referencing and existing Vulkan image handle.
@@ -50,19 +64,62 @@ public:
 	~Image();
 
 	/**
-	* @brief Copies buffer to this Image.
+	* @brief Copies buffer to this Image on the transfer queue without waiting for the copy. Passes executing later wait for it.
 	* 
 	* Does not resize of transform data in buffer
 	* 
-	* @param buffer Buffer to copy to this Image
+	* @param buffer Buffer to copy to this Image. Kept alive until the copy completes
+	*/
+	void copyBufferToImage(std::shared_ptr<const Buffer> buffer);
+
+	/**
+	* @brief Copies this Image to buffer and blocks until the copy completes.
+	* 
+	* This Image must have been registered for TRANSFER_SOURCE access. It is returned to the layout required by currentAccess afterwards.
+	* 
+	* @param buffer Buffer to copy this Image to
+	* @param currentAccess how this Image was last accessed
 	*/
-	void copyBufferToImage(const Buffer& buffer);
+	void copyImageToBuffer(const Buffer& buffer, AccessSpecifier currentAccess);
 
 	void createLayoutBinding(int index, AccessSpecifier access, VkDescriptorSetLayoutBinding& out) const override;
-	void createDescriptorWrite(int index, AccessSpecifier access, const VkDescriptorSet& descriptorSet, VkWriteDescriptorSet& out) const override;
+	void createDescriptorWrite(int index, AccessSpecifier access, const VkDescriptorSet& descriptorSet, uint32_t frameSlot, VkWriteDescriptorSet& out) const override;
 
 	void prepareForInitialAccess(VkCommandBuffer& commandBuffer, AccessSpecifier currentAccess) override;
-	void insertBarrier(VkCommandBuffer& commandBuffer, AccessSpecifier previousAccess, AccessSpecifier currentAccess) override;
+	void addBarrier(BarrierBatch& batch, const std::vector<AccessSpecifier>& previousAccesses, AccessSpecifier currentAccess, bool discardContent = false) override;
+
+	bool requiresLayoutTransition(const AccessSpecifier& previousAccess, const AccessSpecifier& currentAccess) const override;
+
+	bool isTransient() const override;
+
+	/**
+	* @brief Returns the memory requirements of this Image. Only valid after initialization.
+	* 
+	* @return Vulkan memory requirements
+	*/
+	VkMemoryRequirements getMemoryRequirements();
+
+	/**
+	* @brief Binds a transient Image to memory it may share with other transient Images, and creates its view. Must be called once after initialization and before any pass uses this Image.
+	* 
+	* @param allocation memory to bind to. Not freed by this Image
+	* @param precedingAlias transient Image using the same memory before this one in a frame, cyclically. This Image if it shares memory with no other
+	*/
+	void bindMemory(VmaAllocation allocation, Image* precedingAlias);
+
+	/**
+	* @brief Returns whether this Image is only used as a render pass attachment within a frame, so its memory may be allocated lazily on devices supporting it. Only valid after initialization.
+	*
+	* @return whether this is a transient attachment
+	*/
+	bool isTransientAttachment() const;
+
+	/**
+	* @brief Returns the transient Image that uses this Image's memory before it in a frame, cyclically. Its accesses must complete before this Image's first access of a frame.
+	* 
+	* @return preceding Image. This Image if it doesn't share memory
+	*/
+	Image* getPrecedingAlias();
 
 	/**
 	* @brief Returns attachment description and attachment reference for this Image, transitioning into the layout required by accessSpecifier.
@@ -73,9 +130,10 @@ public:
 	* @param attachmentNumber the index of the attachment
 	* @param attachmentDescription result
 	* @param attachmentReference result
-	* @param blend whether blending is enabled for this Image
+	* @param loadContent whether the current content is read, e.g. for blending. Otherwise the attachment is cleared
+	* @param storeContent whether the content written is used after the render pass. Otherwise it may be discarded
 	*/
-	void getAttachmentDescription(AccessSpecifier currentAccess, uint32_t attachmentNumber, VkAttachmentDescription& attachmentDescription, VkAttachmentReference& attachmentReference, bool blend);
+	void getAttachmentDescription(AccessSpecifier currentAccess, uint32_t attachmentNumber, VkAttachmentDescription& attachmentDescription, VkAttachmentReference& attachmentReference, bool loadContent, bool storeContent);
 
 	/**
 	* @brief Returns underlying Vulkan image handle.
@@ -106,7 +164,7 @@ public:
 	const VkFormat& getFormat();
 
 	/**
-	* @brief Returns the dimensions of this Image.
+	* @brief Returns the dimensions of this Image. Known from construction for empty Images, otherwise only after initialization.
 	* 
 	* @return image extent
 	*/
@@ -118,19 +176,35 @@ private:
 	static const std::unordered_map<AccessSpecifier::OPERATION, VkBufferUsageFlags> USE_USAGE_FLAGS;
 	static const std::unordered_map<AccessSpecifier::OPERATION, VkImageAspectFlags> USE_ASPECT_FLAGS;
 
-	VkImage image;
-	VmaAllocation imageAllocation;
-	VkImageView imageView;
-	VkSampler sampler;
+	VkImage image = VK_NULL_HANDLE;
+	VmaAllocation imageAllocation = VK_NULL_HANDLE;
+	VkImageView imageView = VK_NULL_HANDLE;
+	VkSampler sampler = VK_NULL_HANDLE;
 	VkFormat format;
 	VkMemoryPropertyFlags memoryProperties;
-	VkExtent2D extent;
+	VkExtent2D extent{};
+
+	// aspects of the view, kept to create the view of a transient Image once it's bound
+	VkImageAspectFlags aspectFlags = 0;
+
+	LIFETIME lifetime = LIFETIME::PERSISTENT;
+
+	// usage flags the Image was created with
+	VkImageUsageFlags usageFlags = 0;
+
+	Image* precedingAlias = this;
 
 	// Some Image objects reference an image created elswhere
 	bool responsibleForImageDestruction = false;
 
+	// texture data decoded by load, released once initialize has staged it
+	std::unique_ptr<PixelDataContainer> pixels;
+
 	void init(VkFormat format, VkImageUsageFlags usage, VkMemoryPropertyFlags memoryProperties, VkExtent2D extent, VkImageAspectFlags aspect);
 
 	void initializeEmptyImage(VkExtent2D extent, VkFormat format, ACCESS_PROPERTY accessProperty);
+
+	// copies from source starting at sourceOffset on the upload queue. onComplete runs once the copy finished executing
+	void copyToImage(VkBuffer source, VkDeviceSize sourceOffset, std::function<void()> onComplete);
 };
 
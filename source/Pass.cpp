@@ -1,27 +1,18 @@
 #include "Pass.h"
 
+#include <algorithm>
 #include <array>
 #include <fstream>
 
 Pass::Pass(VulkanCore& vulkanCoreSupport, std::vector<ResourceShaderInterface> resources) : vulkanCoreSupport(vulkanCoreSupport), resources(resources)
 {
-	// create fence
-	VkFenceCreateInfo fenceInfo{};
-	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-	if (vkCreateFence(vulkanCoreSupport.getDevice(), &fenceInfo, nullptr, &notExecuting) != VK_SUCCESS)
-	{
-		throw std::runtime_error("failed to create descriptor fence");
-	}
-
-	// register fence with descriptors
+	// register accesses with resources
 	for (ResourceShaderInterface& resourceAccess : resources)
 	{
-		resourceAccess.resource.resource->registerResourceUse(notExecuting, resourceAccess.resource.accessSpecifier);
+		resourceAccess.resource.resource->registerResourceUse(resourceAccess.resource.accessSpecifier);
 	}
 
 	createDescriptorSetLayout();
-	allocateCommandBuffer();
 }
 
 Pass::~Pass()
@@ -29,21 +20,19 @@ Pass::~Pass()
 	VkDevice& device = vulkanCoreSupport.getDevice();
 
 	vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
-	vkFreeCommandBuffers(device, vulkanCoreSupport.getCommandPool(), 1, &commandBuffer);
+	for (size_t i = 0; i < commandBuffers.size(); i++)
+	{
+		vkFreeCommandBuffers(device, commandPools.at(i), 1, &commandBuffers.at(i));
+	}
 }
 
-void Pass::prepareExecution(std::function<void(VkCommandBuffer, Pass*)> insertBarriers)
+void Pass::createExecutionObjects()
 {
-	createDescriptorSet();
 }
 
-void Pass::execute()
+void Pass::prepareExecution()
 {
-	// set this pass to executing
-	vkWaitForFences(vulkanCoreSupport.getDevice(), 1, &notExecuting, VK_TRUE, UINT64_MAX);
-	vkResetFences(vulkanCoreSupport.getDevice(), 1, &notExecuting);
-
-	vulkanCoreSupport.submitCommandBuffer(commandBuffer, notExecuting);
+	createDescriptorSets();
 }
 
 void Pass::createDescriptorSetLayout()
@@ -71,57 +60,133 @@ void Pass::createDescriptorSetLayout()
 	}
 }
 
-void Pass::createDescriptorSet()
+void Pass::createDescriptorSets()
 {
+	uint32_t framesInFlight = vulkanCoreSupport.getFramesInFlight();
+	std::vector<VkDescriptorSetLayout> layouts(framesInFlight, descriptorSetLayout);
+
 	VkDescriptorSetAllocateInfo allocInfo{};
 	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
 	allocInfo.descriptorPool = vulkanCoreSupport.getDescriptorPool();
-	allocInfo.descriptorSetCount = 1;
-	allocInfo.pSetLayouts = &descriptorSetLayout;
+	allocInfo.descriptorSetCount = framesInFlight;
+	allocInfo.pSetLayouts = layouts.data();
 
+	descriptorSets.resize(framesInFlight);
 
-	VkResult result = vkAllocateDescriptorSets(vulkanCoreSupport.getDevice(), &allocInfo, &descriptorSet);
+	VkResult result = vkAllocateDescriptorSets(vulkanCoreSupport.getDevice(), &allocInfo, descriptorSets.data());
 	if (result != VK_SUCCESS)
 	{
 		throw std::runtime_error("failed to allocate descriptor sets");
 	}
 
-	std::vector<VkWriteDescriptorSet> descriptorWrites;
+	for (uint32_t frameSlot = 0; frameSlot < framesInFlight; frameSlot++)
+	{
+		for (const ResourceShaderInterface& resource : resources)
+		{
+			if (resource.isDescriptor())
+			{
+				VkWriteDescriptorSet descriptorWrite;
+				resource.resource.resource->createDescriptorWrite(resource.descriptorBinding, resource.resource.accessSpecifier, descriptorSets.at(frameSlot), frameSlot, descriptorWrite);
+			}
+		}
+	}
+}
+
+void Pass::getDynamicOffsets(uint32_t frameSlot, std::vector<uint32_t>& out) const
+{
+	std::vector<std::pair<int, uint32_t>> bindingOffsets;
 	for (const ResourceShaderInterface& resource : resources)
 	{
-		if (resource.isDescriptor())
+		uint32_t offset = 0;
+		if (resource.isDescriptor() && resource.resource.resource->getDynamicOffset(resource.uniformBlock, frameSlot, offset))
 		{
-			VkWriteDescriptorSet descriptorWrite;
-			resource.resource.resource->createDescriptorWrite(resource.descriptorBinding, resource.resource.accessSpecifier, descriptorSet, descriptorWrite);
+			bindingOffsets.push_back({ resource.descriptorBinding, offset });
 		}
 	}
+
+	std::sort(bindingOffsets.begin(), bindingOffsets.end());
+
+	out.clear();
+	for (const std::pair<int, uint32_t>& bindingOffset : bindingOffsets)
+	{
+		out.push_back(bindingOffset.second);
+	}
 }
 
-void Pass::allocateCommandBuffer()
+void Pass::allocateCommandBuffers(uint32_t threadIndex)
 {
-	VkCommandBufferAllocateInfo allocInfo{};
-	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocInfo.commandPool = vulkanCoreSupport.getCommandPool();
-	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	allocInfo.commandBufferCount = 1;
+	uint32_t framesInFlight = vulkanCoreSupport.getFramesInFlight();
+	commandBuffers.resize(framesInFlight);
+	commandPools.resize(framesInFlight);
 
-	if (vkAllocateCommandBuffers(vulkanCoreSupport.getDevice(), &allocInfo, &commandBuffer) != VK_SUCCESS)
+	// each frame slot has its own pool so a slot's pool is never in use by the GPU while another slot records
+	for (uint32_t frameSlot = 0; frameSlot < framesInFlight; frameSlot++)
 	{
-		throw std::runtime_error("failed to allocate command buffers");
+		commandPools.at(frameSlot) = vulkanCoreSupport.getCommandPool(threadIndex, frameSlot, getQueue());
+
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = commandPools.at(frameSlot);
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandBufferCount = 1;
+
+		if (vkAllocateCommandBuffers(vulkanCoreSupport.getDevice(), &allocInfo, &commandBuffers.at(frameSlot)) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to allocate command buffers");
+		}
 	}
 }
 
-void Pass::startCommandBufferRecording(std::function<void(VkCommandBuffer, Pass*)> insertBarriers)
+void Pass::startCommandBufferRecording(std::function<void(VkCommandBuffer, Pass*)> insertBarriers, uint32_t frameSlot)
 {
 	VkCommandBufferBeginInfo beginInfo{};
 	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 
-	if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+	if (vkBeginCommandBuffer(commandBuffers.at(frameSlot), &beginInfo) != VK_SUCCESS)
 	{
 		throw std::runtime_error("failed to begin recording command buffer!");
 	}
 
-	insertBarriers(commandBuffer, this);
+	insertBarriers(commandBuffers.at(frameSlot), this);
+}
+
+void Pass::recordCommandBuffers(std::function<void(VkCommandBuffer, Pass*)> insertBarriers, uint32_t threadIndex)
+{
+	// the recording Pass records the commands of this one
+	if (getRecordingPass() != this)
+	{
+		return;
+	}
+
+	if (commandBuffers.empty())
+	{
+		allocateCommandBuffers(threadIndex);
+	}
+
+	insertBarriersFunction = insertBarriers;
+	outdatedCommandBuffers.assign(commandBuffers.size(), false);
+
+	for (uint32_t frameSlot = 0; frameSlot < commandBuffers.size(); frameSlot++)
+	{
+		recordCommandBuffer(insertBarriers, frameSlot);
+	}
+}
+
+void Pass::invalidateCommandBuffers()
+{
+	outdatedCommandBuffers.assign(outdatedCommandBuffers.size(), true);
+}
+
+void Pass::updateCommandBuffer(uint32_t frameSlot)
+{
+	if (outdatedCommandBuffers.empty() || !outdatedCommandBuffers.at(frameSlot))
+	{
+		return;
+	}
+
+	// the pool was created to reset command buffers individually, so beginning the recording resets this one
+	recordCommandBuffer(insertBarriersFunction, frameSlot);
+	outdatedCommandBuffers.at(frameSlot) = false;
 }
 
 VulkanCore& Pass::getVulkanCoreSupport()
@@ -129,17 +194,27 @@ VulkanCore& Pass::getVulkanCoreSupport()
 	return vulkanCoreSupport;
 }
 
-void Pass::endCommandBufferRecording()
+void Pass::endCommandBufferRecording(uint32_t frameSlot)
 {
-	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+	if (vkEndCommandBuffer(commandBuffers.at(frameSlot)) != VK_SUCCESS)
 	{
 		throw std::runtime_error("failed to record command buffer");
 	}
 }
 
-VkCommandBuffer& Pass::getCommandBuffer()
+VkCommandBuffer& Pass::getCommandBuffer(uint32_t frameSlot)
+{
+	return commandBuffers.at(frameSlot);
+}
+
+Pass* Pass::getRecordingPass()
+{
+	return this;
+}
+
+VulkanCore::QUEUE Pass::getQueue() const
 {
-	return commandBuffer;
+	return VulkanCore::QUEUE::GRAPHICS;
 }
 
 void Pass::getResources(std::vector<ResourceAccessSpecifier>& output) const
@@ -150,4 +225,20 @@ void Pass::getResources(std::vector<ResourceAccessSpecifier>& output) const
 	{
 		output.push_back(resource.resource);
 	}
-}
\ No newline at end of file
+}
+
+void Pass::setContentUse(const Resource* resource, ResourceContentUse contentUse)
+{
+	contentUses[resource] = contentUse;
+}
+
+ResourceContentUse Pass::getContentUse(const Resource* resource) const
+{
+	auto contentUse = contentUses.find(resource);
+	if (contentUse == contentUses.end())
+	{
+		return ResourceContentUse{};
+	}
+
+	return contentUse->second;
+}
@@ -1,6 +1,7 @@
 #pragma once
 #include <vector>
 #include <functional>
+#include <unordered_map>
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 
@@ -30,24 +31,60 @@ public:
 	virtual ~Pass();
 
 	/**
-	* @brief Completes initialization required for executing this Pass.
+	* @brief Allocates the descriptor sets of this Pass. Uses the shared descriptor pool, so must not run concurrently with other passes.
+	*/
+	virtual void prepareExecution();
+
+	/**
+	* @brief Creates GPU API objects this Pass needs that don't involve shared pools, such as render passes and pipelines. Called after prepareExecution.
 	* 
+	* May run concurrently with createExecutionObjects and recordCommandBuffers of other passes.
+	*/
+	virtual void createExecutionObjects();
+
+	/**
+	* @brief Records the command buffers of all frame slots. Assumes prepareExecution and createExecutionObjects have been called.
+	*
+	* Command buffers are allocated from the command pools of threadIndex, so passes may record concurrently on different threads.
+	*
 	* @param insertBarriers function recording GPU API synchronization commands
+	* @param threadIndex index of the calling thread in VulkanCore's thread pool
 	*/
-	virtual void prepareExecution(std::function<void(VkCommandBuffer, Pass*)> insertBarriers);
+	void recordCommandBuffers(std::function<void(VkCommandBuffer, Pass*)> insertBarriers, uint32_t threadIndex);
 
 	/**
-	* @brief Submits pass' commands to GPU.
+	* @brief Returns underlying Vulkan command buffer object recorded for a frame slot.
 	* 
+	* @param frameSlot frame slot the command buffer is submitted in
+	* @return handle to Vulkan command buffer object
+	*/
+	VkCommandBuffer& getCommandBuffer(uint32_t frameSlot);
+
+	/**
+	* @brief Marks the command buffers of all frame slots as outdated, e.g. because data recorded into them changed. They are re-recorded by updateCommandBuffer.
+	*/
+	void invalidateCommandBuffers();
+
+	/**
+	* @brief Re-records the command buffer of a frame slot if it was invalidated since it was last recorded. The frame last submitted in frameSlot must have completed.
+	*
+	* @param frameSlot frame slot of the command buffer
 	*/
-	void execute();
+	void updateCommandBuffer(uint32_t frameSlot);
 
 	/**
-	* @brief Returns underlying Vulkan command buffer object.
+	* @brief Returns the Pass whose command buffers contain the commands of this Pass. Passes merged into another Pass have no command buffers of their own and aren't submitted.
 	* 
-	* @return handle to Vulkan command buffer object
+	* @return recording Pass. This Pass unless it was merged
 	*/
-	VkCommandBuffer& getCommandBuffer();
+	virtual Pass* getRecordingPass();
+
+	/**
+	* @brief Returns the queue the command buffers of this Pass are submitted to.
+	*
+	* @return queue. GRAPHICS unless the Pass executes on another queue
+	*/
+	virtual VulkanCore::QUEUE getQueue() const;
 
 	/**
 	* @brief Returns resources accessed in this Pass.
@@ -56,6 +93,14 @@ public:
 	*/
 	void getResources(std::vector<ResourceAccessSpecifier>& output) const;
 
+	/**
+	* @brief Notifies this Pass how the content of one of its resources is used around its access, so it may skip loading or storing it. Must be called before createExecutionObjects.
+	*
+	* @param resource resource accessed by this Pass
+	* @param contentUse how the content of resource is used by other accesses
+	*/
+	void setContentUse(const Resource* resource, ResourceContentUse contentUse);
+
 protected:
 
 	/**
@@ -64,34 +109,58 @@ protected:
 	VkDescriptorSetLayout descriptorSetLayout;
 
 	/**
-	* @brief handle to Vulkan descriptor set
+	* @brief handles to Vulkan descriptor sets, one per frame slot
 	*/
-	VkDescriptorSet descriptorSet;
+	std::vector<VkDescriptorSet> descriptorSets;
 
 	/**
-	* @brief handle to Vulkan command buffer
+	* @brief handles to Vulkan command buffers, one per frame slot
 	*/
-	VkCommandBuffer commandBuffer;
+	std::vector<VkCommandBuffer> commandBuffers;
+
+	/**
+	* @brief command pool each element of commandBuffers was allocated from
+	*/
+	std::vector<VkCommandPool> commandPools;
 
 	/**
 	* @brief Prepares GPU command buffer for recording. Assumes called before endCommandBufferRecording.
 	* 
 	* @param insertBarriers function recording GPU API synchronization commands
+	* @param frameSlot frame slot of the command buffer to record
 	*/
-	void startCommandBufferRecording(std::function<void(VkCommandBuffer, Pass*)> insertBarriers);
+	void startCommandBufferRecording(std::function<void(VkCommandBuffer, Pass*)> insertBarriers, uint32_t frameSlot);
 
 	/**
 	* @brief Ends GPU command buffer recording. Assumes called after startCommandBufferRecording.
 	* 
+	* @param frameSlot frame slot of the command buffer being recorded
 	*/
-	void endCommandBufferRecording();
+	void endCommandBufferRecording(uint32_t frameSlot);
 
 	/**
-	* @brief Records GPU commands.
+	* @brief Records GPU commands to the command buffer of a frame slot.
 	* 
 	* @param insertBarriers function recording GPU API synchronization commands
+	* @param frameSlot frame slot of the command buffer to record
 	*/
-	virtual void recordCommandBuffer(std::function<void(VkCommandBuffer, Pass*)> insertBarriers) = 0;
+	virtual void recordCommandBuffer(std::function<void(VkCommandBuffer, Pass*)> insertBarriers, uint32_t frameSlot) = 0;
+
+	/**
+	* @brief Returns how the content of a resource is used around the access of this Pass. Resources that weren't described get the conservative default.
+	*
+	* @param resource resource accessed by this Pass
+	* @return how the content of resource is used by other accesses
+	*/
+	ResourceContentUse getContentUse(const Resource* resource) const;
+
+	/**
+	* @brief Returns the dynamic offsets to bind the descriptor set of a frame slot with, ordered by binding as vkCmdBindDescriptorSets expects.
+	*
+	* @param frameSlot frame slot of the descriptor set
+	* @param out dynamic offsets
+	*/
+	void getDynamicOffsets(uint32_t frameSlot, std::vector<uint32_t>& out) const;
 
 	VulkanCore& getVulkanCoreSupport();
 
@@ -101,11 +170,17 @@ private:
 
 	std::vector<ResourceShaderInterface> resources;
 
-	VkFence notExecuting;
+	std::unordered_map<const Resource*, ResourceContentUse> contentUses;
+
+	// kept from recordCommandBuffers for re-recording. The barriers of a pass don't change after registration
+	std::function<void(VkCommandBuffer, Pass*)> insertBarriersFunction;
+
+	// whether the command buffer of each frame slot must be re-recorded before its next submission
+	std::vector<bool> outdatedCommandBuffers;
 
 	void createDescriptorSetLayout();
-	void createDescriptorSet();
+	void createDescriptorSets();
 
-	void allocateCommandBuffer();
+	void allocateCommandBuffers(uint32_t threadIndex);
 
 };
\ No newline at end of file
@@ -1,71 +1,425 @@
 #include "PassDependencyManager.h"
 
 #include <unordered_set>
+#include <algorithm>
 
-std::unordered_map<Pass*, std::vector<ResourceAccessHazard>> PassDependencyManager::predecessorResources{};
+std::unordered_map<Pass*, std::vector<ResourceAccessHazard>> PassDependencyManager::passBarriers{};
 
-void PassDependencyManager::preparePasses()
+BarrierStatistics PassDependencyManager::barrierStatistics{};
+
+std::unordered_map<Pass*, VkPipelineStageFlags> PassDependencyManager::crossQueueWaitStages{};
+std::unordered_map<Pass*, VkPipelineStageFlags> PassDependencyManager::uploadWaitStages{};
+
+bool isSameAccess(const AccessSpecifier& first, const AccessSpecifier& second)
+{
+	return first.operation == second.operation && first.stage == second.stage;
+}
+
+bool isOnOtherQueue(const std::vector<VulkanCore::QUEUE>& queues, VulkanCore::QUEUE queue)
+{
+	return std::any_of(queues.begin(), queues.end(), [queue](VulkanCore::QUEUE otherQueue) { return otherQueue != queue; });
+}
+
+void PassDependencyManager::preparePasses(VulkanCore& vulkanCoreSupport)
+{
+	std::vector<Pass*> passes;
+	for (const auto& pair : passBarriers)
+	{
+		passes.push_back(pair.first);
+	}
+
+	// descriptor set allocation uses the shared descriptor pool, so it stays on this thread
+	for (Pass* pass : passes)
+	{
+		pass->prepareExecution();
+	}
+
+	// pipeline compilation dominates startup and the objects involved may be created concurrently. Each thread records into its own command pools
+	vulkanCoreSupport.getThreadPool().parallelFor(passes.size(), [&passes](size_t index, uint32_t threadIndex)
+	{
+		passes.at(index)->createExecutionObjects();
+		passes.at(index)->recordCommandBuffers(&insertBarriers, threadIndex);
+	});
+}
+
+void PassDependencyManager::trackAccess(std::unordered_map<Resource*, ResourceState>& states, const ResourceAccessSpecifier& access, VulkanCore::QUEUE queue, std::vector<ResourceAccessHazard>* barriers)
+{
+	const AccessSpecifier& currentAccess = access.accessSpecifier;
+	ResourceState& state = states[access.resource];
+
+	// nothing precedes the first access, so there's nothing to wait for or transition from
+	if (state.layoutAccess.operation == AccessSpecifier::OPERATION::NO_OPERATION)
+	{
+		state.layoutAccess = currentAccess;
+		state.modificationQueue = queue;
+		if (currentAccess.isWriteAccess())
+		{
+			state.modification = currentAccess;
+		}
+		else
+		{
+			state.reads = { currentAccess };
+			state.readQueues = { queue };
+		}
+
+		if (barriers)
+		{
+			barrierStatistics.elided++;
+		}
+		return;
+	}
+
+	bool hasModification = state.modification.operation != AccessSpecifier::OPERATION::NO_OPERATION;
+
+	// layout transitions happen in the barrier before an access, so they modify the resource like a write does
+	if (currentAccess.isWriteAccess() || access.resource->requiresLayoutTransition(state.layoutAccess, currentAccess))
+	{
+		// the reads already wait for the modification, so waiting for them covers it
+		std::vector<AccessSpecifier> srcAccesses = state.reads;
+		std::vector<VulkanCore::QUEUE> srcQueues = state.readQueues;
+		if (srcAccesses.empty())
+		{
+			srcAccesses.push_back(hasModification ? state.modification : state.layoutAccess);
+			srcQueues.push_back(state.modificationQueue);
+		}
+
+		if (barriers)
+		{
+			barriers->push_back(ResourceAccessHazard{ access.resource, srcAccesses, currentAccess, false, isOnOtherQueue(srcQueues, queue) });
+			barrierStatistics.recorded++;
+		}
+
+		state.layoutAccess = currentAccess;
+		state.modification = currentAccess;
+		state.modificationQueue = queue;
+		state.reads.clear();
+		state.readQueues.clear();
+		if (!currentAccess.isWriteAccess())
+		{
+			state.reads.push_back(currentAccess);
+			state.readQueues.push_back(queue);
+		}
+		return;
+	}
+
+	// read-after-read in the same layout. Only the first read of each kind on each queue after a modification has to wait for it, since barriers don't order work on other queues
+	bool alreadyVisible = !hasModification;
+	for (size_t readIndex = 0; readIndex < state.reads.size(); readIndex++)
+	{
+		alreadyVisible = alreadyVisible || (isSameAccess(state.reads.at(readIndex), currentAccess) && state.readQueues.at(readIndex) == queue);
+	}
+
+	if (barriers)
+	{
+		if (alreadyVisible)
+		{
+			barrierStatistics.elided++;
+		}
+		else
+		{
+			barriers->push_back(ResourceAccessHazard{ access.resource, { state.modification }, currentAccess, false, state.modificationQueue != queue });
+			barrierStatistics.recorded++;
+		}
+	}
+
+	state.reads.push_back(currentAccess);
+	state.readQueues.push_back(queue);
+}
+
+void PassDependencyManager::trackTransientFirstAccess(std::unordered_map<Resource*, ResourceState>& states, const ResourceAccessSpecifier& access, VulkanCore::QUEUE queue, std::vector<ResourceAccessHazard>& barriers)
+{
+	const AccessSpecifier& currentAccess = access.accessSpecifier;
+
+	// the memory was last used by the preceding alias, possibly in the previous frame. Its content is of no use, so waiting for its accesses and discarding is enough
+	Resource* precedingAlias = static_cast<Image*>(access.resource)->getPrecedingAlias();
+	const ResourceState& precedingState = states.at(precedingAlias);
+
+	std::vector<AccessSpecifier> srcAccesses = precedingState.reads;
+	std::vector<VulkanCore::QUEUE> srcQueues = precedingState.readQueues;
+	if (srcAccesses.empty())
+	{
+		srcAccesses.push_back(precedingState.modification.operation != AccessSpecifier::OPERATION::NO_OPERATION ? precedingState.modification : precedingState.layoutAccess);
+		srcQueues.push_back(precedingState.modificationQueue);
+	}
+
+	barriers.push_back(ResourceAccessHazard{ access.resource, srcAccesses, currentAccess, true, isOnOtherQueue(srcQueues, queue) });
+	barrierStatistics.recorded++;
+
+	ResourceState& state = states.at(access.resource);
+	state.layoutAccess = currentAccess;
+	state.modification = currentAccess;
+	state.modificationQueue = queue;
+	state.reads.clear();
+	state.readQueues.clear();
+	if (!currentAccess.isWriteAccess())
+	{
+		state.reads.push_back(currentAccess);
+		state.readQueues.push_back(queue);
+	}
+}
+
+void PassDependencyManager::transitionToFrameStartStates(VulkanCore& vulkanCoreSupport, const std::unordered_map<Resource*, ResourceState>& states)
+{
+	BarrierBatch batch;
+
+	// resources in use by earlier frames, if passes are registered again, are transitioned once those have completed
+	uint64_t lastUseSubmission = 0;
+
+	for (const auto& pair : states)
+	{
+		Resource* resource = pair.first;
+		const AccessSpecifier& initialAccess = resource->getInitialAccess();
+		const AccessSpecifier& frameStartAccess = pair.second.layoutAccess;
+
+		// transient resources are discarded by their first access of every frame, so their state before it doesn't matter
+		if (resource->isTransient())
+		{
+			continue;
+		}
+
+		// content written before execution, e.g. by an upload, must be preserved, so the transition starts from the layout it was written in rather than an undefined one
+		if (initialAccess.isWriteAccess() || resource->requiresLayoutTransition(initialAccess, frameStartAccess))
+		{
+			// the first frame waits for this at any stage, whichever passes access the resource first
+			resource->addBarrier(batch, { initialAccess }, AccessSpecifier{ frameStartAccess.operation, AccessSpecifier::STAGE::INITIAL });
+			lastUseSubmission = std::max(lastUseSubmission, resource->getLastUseSubmission());
+		}
+	}
+
+	// the transitions are recorded with the initial uploads, whose queue may not support the stages of the first accesses. Passes wait for the uploads before using the resources
+	if (!batch.isEmpty())
+	{
+		batch.orderBeforeLaterCommands();
+		vulkanCoreSupport.executeUploadCommands([&batch](VkCommandBuffer commandBuffer)
+		{
+			batch.record(commandBuffer);
+		}, nullptr, lastUseSubmission);
+	}
+
+	// the initial uploads and transitions share one submission, which executes while the passes are prepared
+	vulkanCoreSupport.flushUploads();
+}
+
+void PassDependencyManager::describeContentUses(const std::vector<Pass*>& passes, const std::vector<Resource*>& outputs)
 {
-	for (const auto& pair : predecessorResources)
+	// a persistent resource carries its content into the next frame, so only transient resources are described
+	std::unordered_map<Resource*, std::vector<size_t>> accessingPasses;
+	for (size_t passIndex = 0; passIndex < passes.size(); passIndex++)
 	{
-		pair.first->prepareExecution(&insertBarriers);
+		std::vector<ResourceAccessSpecifier> accesses;
+		passes.at(passIndex)->getResources(accesses);
+
+		for (const ResourceAccessSpecifier& access : accesses)
+		{
+			if (access.resource->isTransient())
+			{
+				accessingPasses[access.resource].push_back(passIndex);
+			}
+		}
+	}
+
+	std::unordered_set<Resource*> outputSet(outputs.begin(), outputs.end());
+	for (const auto& resourcePasses : accessingPasses)
+	{
+		const std::vector<size_t>& passIndices = resourcePasses.second;
+		for (size_t passIndex : passIndices)
+		{
+			ResourceContentUse contentUse;
+			contentUse.previousContentDefined = passIndex != passIndices.front();
+			contentUse.contentUsedLater = passIndex != passIndices.back() || outputSet.count(resourcePasses.first) > 0;
+
+			passes.at(passIndex)->setContentUse(resourcePasses.first, contentUse);
+		}
 	}
 }
 
-void PassDependencyManager::registerPasses(std::vector<DependencyList> dependencies)
+void PassDependencyManager::registerPasses(VulkanCore& vulkanCoreSupport, std::vector<DependencyList> dependencies, const std::vector<Pass*>& presentPasses, const std::vector<Resource*>& outputs)
 {
-	predecessorResources.clear();
+	passBarriers.clear();
+	barrierStatistics = BarrierStatistics{};
 
+	// the state resources are left in at the end of a frame, which is the state the next frame starts in. Every resource a frame modifies ends up in a state independent of the one it started in
+	std::unordered_map<Resource*, ResourceState> states;
 	for (const DependencyList& dependencyList : dependencies)
 	{
-		std::vector<ResourceAccessSpecifier> dstAccesses;
-		dependencyList.pass->getResources(dstAccesses);
+		std::vector<ResourceAccessSpecifier> accesses;
+		dependencyList.pass->getResources(accesses);
+
+		for (const ResourceAccessSpecifier& access : accesses)
+		{
+			trackAccess(states, access, dependencyList.pass->getQueue(), nullptr);
+		}
+	}
+
+	transitionToFrameStartStates(vulkanCoreSupport, states);
+
+	// pipeline barriers wait for all earlier commands on the queue, including those of previous frames, so tracking continues from the end of the previous frame
+	std::unordered_set<Resource*> accessedResources;
 
-		std::vector<ResourceAccessHazard> sharedAccesses;
+	// resources accessed by the passes merged into the current recording pass so far
+	std::unordered_set<Resource*> mergedResources;
 
-		for (const auto& dstAccess : dstAccesses)
+	for (const DependencyList& dependencyList : dependencies)
+	{
+		std::vector<ResourceAccessSpecifier> accesses;
+		dependencyList.pass->getResources(accesses);
+
+		// barriers can't be recorded inside a render pass, so those of merged passes are recorded by the pass recording them, before it begins
+		Pass* recordingPass = dependencyList.pass->getRecordingPass();
+		std::vector<ResourceAccessHazard>& barriers = passBarriers[recordingPass];
+		if (recordingPass == dependencyList.pass)
 		{
-			for (const auto& srcPass : dependencyList.dependenices)
+			mergedResources.clear();
+		}
+
+		for (const ResourceAccessSpecifier& access : accesses)
+		{
+			// a dependency between the merged passes takes the place of barriers between them
+			std::vector<ResourceAccessHazard> mergedBarriers;
+			bool accessedByMergedPass = mergedResources.count(access.resource) > 0;
+			std::vector<ResourceAccessHazard>& accessBarriers = accessedByMergedPass ? mergedBarriers : barriers;
+
+			bool firstAccess = accessedResources.insert(access.resource).second;
+			if (firstAccess && access.resource->isTransient())
 			{
-				std::vector<ResourceAccessSpecifier> srcAccesses;
-				srcPass->getResources(srcAccesses);
-
-				for (const auto& srcAccess : srcAccesses)
-				{
-					if (srcAccess.resource == dstAccess.resource)
-					{
-						sharedAccesses.push_back(ResourceAccessHazard{ srcAccess.resource, srcAccess.accessSpecifier, dstAccess.accessSpecifier });
-					}
-				}
+				trackTransientFirstAccess(states, access, dependencyList.pass->getQueue(), accessBarriers);
 			}
+			else
+			{
+				trackAccess(states, access, dependencyList.pass->getQueue(), &accessBarriers);
+			}
+
+			barrierStatistics.recorded -= static_cast<uint32_t>(mergedBarriers.size());
+			barrierStatistics.elided += static_cast<uint32_t>(mergedBarriers.size());
+		}
+
+		for (const ResourceAccessSpecifier& access : accesses)
+		{
+			mergedResources.insert(access.resource);
 		}
 
-		predecessorResources.insert(std::pair<Pass*, std::vector<ResourceAccessHazard>>(dependencyList.pass, sharedAccesses));
+		// every registered pass is prepared, including merged ones
+		passBarriers.emplace(dependencyList.pass, std::vector<ResourceAccessHazard>{});
+	}
+
+	// each present pass continues from the end of the frame on its own, since only one of them executes. Resources they alone access, such as swap chain images, are prepared by the passes themselves
+	for (Pass* presentPass : presentPasses)
+	{
+		std::unordered_map<Resource*, ResourceState> presentStates = states;
+
+		std::vector<ResourceAccessSpecifier> accesses;
+		presentPass->getResources(accesses);
+
+		std::vector<ResourceAccessHazard>& barriers = passBarriers[presentPass];
+		for (const ResourceAccessSpecifier& access : accesses)
+		{
+			trackAccess(presentStates, access, presentPass->getQueue(), &barriers);
+		}
 	}
 
+	// a submission waits for other queues at the stages where its passes' barriers depend on them
+	crossQueueWaitStages.clear();
+	uploadWaitStages.clear();
+	for (const auto& pair : passBarriers)
+	{
+		BarrierBatch crossQueueBatch;
+		BarrierBatch sameQueueBatch;
+		for (const ResourceAccessHazard& barrier : pair.second)
+		{
+			if (barrier.crossQueue)
+			{
+				barrier.resource->addBarrier(crossQueueBatch, barrier.srcAccesses, barrier.dstAccess, barrier.discardContent);
+			}
+			else if (!barrier.resource->isTransient())
+			{
+				barrier.resource->addBarrier(sameQueueBatch, barrier.srcAccesses, barrier.dstAccess, barrier.discardContent);
+			}
+		}
+
+		crossQueueWaitStages[pair.first] = crossQueueBatch.getDstStageMask();
+
+		// a layout transition of an uploaded Image must follow the upload, which only a barrier waiting for the stages the upload is waited at ensures. Cross-queue barriers already wait for all commands
+		uploadWaitStages[pair.first] = sameQueueBatch.getSrcStageMask();
+	}
+
+	// uploads may write any persistent resource, so a pass also waits for them where it accesses one. Transient resources are discarded by their first access each frame
+	std::vector<Pass*> registeredPasses(presentPasses.begin(), presentPasses.end());
+	for (const DependencyList& dependencyList : dependencies)
+	{
+		registeredPasses.push_back(dependencyList.pass);
+	}
+
+	for (Pass* pass : registeredPasses)
+	{
+		std::vector<ResourceAccessSpecifier> accesses;
+		pass->getResources(accesses);
+
+		BarrierBatch uploadBatch;
+		for (const ResourceAccessSpecifier& access : accesses)
+		{
+			if (!access.resource->isTransient())
+			{
+				access.resource->addBarrier(uploadBatch, { AccessSpecifier{ AccessSpecifier::OPERATION::TRANSFER_DESTINATION, AccessSpecifier::STAGE::TRANSFER } }, access.accessSpecifier);
+			}
+		}
+
+		// merged passes execute in the command buffer of the pass recording them
+		uploadWaitStages[pass->getRecordingPass()] |= uploadBatch.getDstStageMask();
+	}
+
+	// present passes follow the frame's passes
+	std::vector<Pass*> passes;
+	for (const DependencyList& dependencyList : dependencies)
+	{
+		passes.push_back(dependencyList.pass);
+	}
+	passes.insert(passes.end(), presentPasses.begin(), presentPasses.end());
+	describeContentUses(passes, outputs);
+
 	// record command buffers etc. We have to call this after establishing dependencies because because it creates synchronization logic with the GPU API
-	preparePasses();
+	preparePasses(vulkanCoreSupport);
 }
 
+const BarrierStatistics& PassDependencyManager::getBarrierStatistics()
+{
+	return barrierStatistics;
+}
 
-void PassDependencyManager::insertBarriers(VkCommandBuffer commandBuffer, Pass* pass)
+VkPipelineStageFlags PassDependencyManager::getCrossQueueWaitStages(Pass* pass)
 {
-	std::unordered_set<Resource*> preparedResources;
+	auto waitStages = crossQueueWaitStages.find(pass);
+	if (waitStages == crossQueueWaitStages.end())
+	{
+		return 0;
+	}
+
+	return waitStages->second;
+}
 
-	for (const ResourceAccessHazard& access : predecessorResources.at(pass))
+VkPipelineStageFlags PassDependencyManager::getUploadWaitStages(Pass* pass)
+{
+	auto waitStages = uploadWaitStages.find(pass);
+	if (waitStages == uploadWaitStages.end())
 	{
-		access.resource->insertBarrier(commandBuffer, access.srcAccess, access.dstAccess);
-		preparedResources.insert(access.resource);
+		return 0;
 	}
 
-	// other preparation (e.g. memory layout transfer). This code is only used for the initial access of a resource in the pipeline, not accesses between passes.
+	return waitStages->second;
+}
+
+void PassDependencyManager::insertBarriers(VkCommandBuffer commandBuffer, Pass* pass)
+{
+	// all barriers of the pass are recorded in one call, except those following accesses on other queues. The submission's semaphore wait replaces their wait, so they need a source scope of their own
+	BarrierBatch batch;
+	BarrierBatch crossQueueBatch;
 
-	std::vector<ResourceAccessSpecifier> accesses;
-	pass->getResources(accesses);
-	for (const ResourceAccessSpecifier& access : accesses)
+	for (const ResourceAccessHazard& barrier : passBarriers.at(pass))
 	{
-		if (preparedResources.find(access.resource) == preparedResources.end())
-		// Assume no previous access. pass is the first pass to acces access.resource in the pipeline
-		access.resource->insertBarrier(commandBuffer, {AccessSpecifier::OPERATION::NO_OPERATION, AccessSpecifier::STAGE::INITIAL}, access.accessSpecifier);
+		barrier.resource->addBarrier(barrier.crossQueue ? crossQueueBatch : batch, barrier.srcAccesses, barrier.dstAccess, barrier.discardContent);
 	}
+
+	crossQueueBatch.orderAfterSemaphoreWait();
+
+	batch.record(commandBuffer);
+	crossQueueBatch.record(commandBuffer);
 }
@@ -30,14 +30,35 @@ struct ResourceAccessHazard
 	Resource* resource;
 
 	/**
-	* @brief how the first pass accesses the resource
+	* @brief how the preceding passes access the resource. Several unordered passes may precede, e.g. readers before a write
 	*/
-	AccessSpecifier srcAccess;
+	std::vector<AccessSpecifier> srcAccesses;
 
 	/**
 	* @brief how the second pass accesses the resource
 	*/
 	AccessSpecifier dstAccess;
+
+	/**
+	* @brief whether the content of the resource may be discarded, e.g. when the preceding accesses are to another resource sharing its memory
+	*/
+	bool discardContent = false;
+
+	/**
+	* @brief whether a preceding access was made on another queue than the second pass executes on. The submission of the second pass then waits for that queue, which takes the place of the barrier's wait
+	*/
+	bool crossQueue = false;
+};
+
+/**
+* @brief Numbers of barriers recorded for one execution of every registered pass.
+*
+* A barrier is elided when a pass accesses a resource without one, e.g. reading it in the layout an earlier read already made visible. Without elision every access of a pass would get a barrier.
+*/
+struct BarrierStatistics
+{
+	uint32_t recorded = 0;
+	uint32_t elided = 0;
 };
 
 /**
@@ -53,13 +74,72 @@ public:
 	/**
 	* @brief Registers passes with this PassDependencyManager, performing initializing required for execution.
 	* 
-	* @param dependencies passes to register
+	* Barriers are derived by tracking the state of every resource through the execution order. Passes are executed every frame, so the state a resource is left in at the end of a frame is the state the next frame starts from. Resources are transitioned into that state once here, in the submission of the uploads made so far.
+	* 
+	* @param vulkanCoreSupport VulkanCore whose thread pool prepares the passes
+	* @param dependencies passes to register, in execution order
+	* @param presentPasses passes executed after dependencies, at most one per frame. Each must return the resources it shares with dependencies to the state it found them in
+	* @param outputs resources whose content is used after the passes complete, e.g. the presented image
+	*/
+	static void registerPasses(VulkanCore& vulkanCoreSupport, std::vector<DependencyList> dependencies, const std::vector<Pass*>& presentPasses = {}, const std::vector<Resource*>& outputs = {});
+
+	/**
+	* @brief Returns how many barriers the registered passes record and how many were found redundant.
+	*
+	* @return barrier statistics
+	*/
+	static const BarrierStatistics& getBarrierStatistics();
+
+	/**
+	* @brief Returns the stages at which a registered pass waits for work on other queues, because it accesses resources an earlier access on another queue used. The submission containing the pass must wait for the other queues at these stages.
+	*
+	* @param pass registered pass
+	* @return stages waiting for other queues. 0 if the pass doesn't depend on other queues
+	*/
+	static VkPipelineStageFlags getCrossQueueWaitStages(Pass* pass);
+
+	/**
+	* @brief Returns the stages at which a registered pass first accesses resources uploads may write. The submission containing the pass waits for pending uploads at these stages.
+	*
+	* @param pass registered pass
+	* @return stages waiting for uploads. 0 if the pass only accesses transient resources
 	*/
-	static void registerPasses(std::vector<DependencyList> dependencies);
+	static VkPipelineStageFlags getUploadWaitStages(Pass* pass);
 
 private:
-	static std::unordered_map<Pass*, std::vector<ResourceAccessHazard>> predecessorResources;
+
+	// state of a resource between two accesses
+	struct ResourceState
+	{
+		// access whose required layout the resource is in. NO_OPERATION if the resource hasn't been accessed
+		AccessSpecifier layoutAccess{ AccessSpecifier::OPERATION::NO_OPERATION, AccessSpecifier::STAGE::INITIAL };
+
+		// most recent write or layout transition. NO_OPERATION if nothing has to be waited for
+		AccessSpecifier modification{ AccessSpecifier::OPERATION::NO_OPERATION, AccessSpecifier::STAGE::INITIAL };
+
+		// queue modification, or layoutAccess if there's no modification, was made on
+		VulkanCore::QUEUE modificationQueue = VulkanCore::QUEUE::GRAPHICS;
+
+		// accesses since modification that don't change the layout. All are ordered after modification
+		std::vector<AccessSpecifier> reads;
+
+		// queue each element of reads was made on
+		std::vector<VulkanCore::QUEUE> readQueues;
+	};
+
+	static std::unordered_map<Pass*, std::vector<ResourceAccessHazard>> passBarriers;
+
+	static BarrierStatistics barrierStatistics;
+
+	static std::unordered_map<Pass*, VkPipelineStageFlags> crossQueueWaitStages;
+
+	static std::unordered_map<Pass*, VkPipelineStageFlags> uploadWaitStages;
+
+	static void trackAccess(std::unordered_map<Resource*, ResourceState>& states, const ResourceAccessSpecifier& access, VulkanCore::QUEUE queue, std::vector<ResourceAccessHazard>* barriers);
+	static void trackTransientFirstAccess(std::unordered_map<Resource*, ResourceState>& states, const ResourceAccessSpecifier& access, VulkanCore::QUEUE queue, std::vector<ResourceAccessHazard>& barriers);
+	static void describeContentUses(const std::vector<Pass*>& passes, const std::vector<Resource*>& outputs);
+	static void transitionToFrameStartStates(VulkanCore& vulkanCoreSupport, const std::unordered_map<Resource*, ResourceState>& states);
 
 	static void insertBarriers(VkCommandBuffer commandBuffer, Pass* pass);
-	static void preparePasses();
-};
\ No newline at end of file
+	static void preparePasses(VulkanCore& vulkanCoreSupport);
+};
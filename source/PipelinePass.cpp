@@ -1,7 +1,39 @@
 #include "PipelinePass.h"
 
-PipelinePass::PipelinePass(VulkanCore& vulkanCoreSupport, std::vector<ResourceShaderInterface> resources) : Pass(vulkanCoreSupport, resources)
+#include <algorithm>
+#include <cstring>
+
+PipelinePass::PipelinePass(VulkanCore& vulkanCoreSupport, std::vector<ResourceShaderInterface> resources, const std::vector<VkPushConstantRange>& pushConstantRanges) : Pass(vulkanCoreSupport, resources), pushConstantRanges(pushConstantRanges)
 {
+	uint32_t pushConstantSize = 0;
+	for (const VkPushConstantRange& range : pushConstantRanges)
+	{
+		pushConstantSize = std::max(pushConstantSize, range.offset + range.size);
+	}
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(getVulkanCoreSupport().getPhysicalDevice(), &properties);
+	if (pushConstantSize > properties.limits.maxPushConstantsSize)
+	{
+		throw std::runtime_error("push constant ranges exceed the device limit");
+	}
+
+	// each range is pushed with the stages of its own, which is only valid if no other range covers the same bytes. Stages sharing data declare one range with all of them
+	for (size_t i = 0; i < pushConstantRanges.size(); i++)
+	{
+		for (size_t j = i + 1; j < pushConstantRanges.size(); j++)
+		{
+			const VkPushConstantRange& a = pushConstantRanges.at(i);
+			const VkPushConstantRange& b = pushConstantRanges.at(j);
+			if (a.offset < b.offset + b.size && b.offset < a.offset + a.size)
+			{
+				throw std::runtime_error("push constant ranges overlap");
+			}
+		}
+	}
+
+	pushConstantData.resize(pushConstantSize, 0);
+
 	createPipelineLayout();
 }
 
@@ -12,22 +44,58 @@ PipelinePass::~PipelinePass()
 	vkDestroyPipeline(getVulkanCoreSupport().getDevice(), pipeline, nullptr);
 }
 
-void PipelinePass::prepareExecution(std::function<void(VkCommandBuffer, Pass*)> insertBarriers)
-{
-	Pass::prepareExecution(insertBarriers);
-}
-
 void PipelinePass::createPipelineLayout()
 {
 	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
 	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 	pipelineLayoutInfo.setLayoutCount = 1;
 	pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
-	pipelineLayoutInfo.pushConstantRangeCount = 0;
-	pipelineLayoutInfo.pPushConstantRanges = VK_NULL_HANDLE;
+	pipelineLayoutInfo.pushConstantRangeCount = static_cast<uint32_t>(pushConstantRanges.size());
+	pipelineLayoutInfo.pPushConstantRanges = pushConstantRanges.empty() ? VK_NULL_HANDLE : pushConstantRanges.data();
 
 	if (vkCreatePipelineLayout(getVulkanCoreSupport().getDevice(), &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS)
 	{
 		throw std::runtime_error("failed to create pipeline layout");
 	}
+}
+
+void PipelinePass::setPushConstants(uint32_t offset, uint32_t size, const void* data)
+{
+	// ranges don't overlap, so the data lies within them if the parts of it they cover add up to its size. Bytes in gaps between ranges are never pushed
+	uint64_t end = static_cast<uint64_t>(offset) + size;
+	uint64_t coveredSize = 0;
+	for (const VkPushConstantRange& range : pushConstantRanges)
+	{
+		uint64_t rangeEnd = static_cast<uint64_t>(range.offset) + range.size;
+		uint64_t coveredStart = std::max<uint64_t>(offset, range.offset);
+		uint64_t coveredEnd = std::min(end, rangeEnd);
+		if (coveredStart < coveredEnd)
+		{
+			coveredSize += coveredEnd - coveredStart;
+		}
+	}
+
+	if (coveredSize != size)
+	{
+		throw std::runtime_error("push constant data exceeds the declared ranges");
+	}
+
+	// command buffers only need re-recording if the data actually changed
+	if (std::memcmp(pushConstantData.data() + offset, data, size) == 0)
+	{
+		return;
+	}
+
+	std::memcpy(pushConstantData.data() + offset, data, size);
+
+	// a merged pass is recorded into the command buffers of another
+	getRecordingPass()->invalidateCommandBuffers();
+}
+
+void PipelinePass::recordPushConstants(VkCommandBuffer commandBuffer) const
+{
+	for (const VkPushConstantRange& range : pushConstantRanges)
+	{
+		vkCmdPushConstants(commandBuffer, pipelineLayout, range.stageFlags, range.offset, range.size, pushConstantData.data() + range.offset);
+	}
 }
\ No newline at end of file
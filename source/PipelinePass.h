@@ -13,10 +13,19 @@ public:
 	* @brief Creates a PipelinePass.
 	* 
 	* @param resources what resources the pass will use and how
+	* @param pushConstantRanges push constant ranges the shaders declare, with the stages reading each. Ranges must not overlap, so bytes read by several stages go in one range with all of them
 	*/
-	PipelinePass(VulkanCore& vulkanCoreSupport, std::vector<ResourceShaderInterface> resources);
+	PipelinePass(VulkanCore& vulkanCoreSupport, std::vector<ResourceShaderInterface> resources, const std::vector<VkPushConstantRange>& pushConstantRanges = {});
 	virtual ~PipelinePass();
-	virtual void prepareExecution(std::function<void(VkCommandBuffer, Pass*)> insertBarriers) override;
+
+	/**
+	* @brief Sets push constant data for the following executions of this Pass. Data is recorded into the command buffers, which are re-recorded as their frame slots come up, so it takes no buffer write or wait for the GPU. Setting unchanged data does nothing.
+	*
+	* @param offset offset of data within the push constant ranges in bytes
+	* @param size size of data in bytes
+	* @param data data to push. Every byte from offset to offset + size must lie within one of the declared ranges
+	*/
+	void setPushConstants(uint32_t offset, uint32_t size, const void* data);
 
 protected:
 
@@ -28,10 +37,22 @@ protected:
 	/**
 	* @brief hanlde to Vulkan pipeline object
 	*/
-	VkPipeline pipeline;
+	VkPipeline pipeline = VK_NULL_HANDLE;
+
+	/**
+	* @brief Records the current push constant data into commandBuffer. Must follow binding pipeline.
+	*
+	* @param commandBuffer command buffer to record to
+	*/
+	void recordPushConstants(VkCommandBuffer commandBuffer) const;
 
 private:
 
+	std::vector<VkPushConstantRange> pushConstantRanges;
+
+	// data of all push constant ranges, indexed by their offsets
+	std::vector<uint8_t> pushConstantData;
+
 	virtual void createPipelineLayout();
 	virtual void createPipeline() = 0;
 };
\ No newline at end of file
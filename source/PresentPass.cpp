@@ -1,6 +1,6 @@
 #include "PresentPass.h"
 
-PresentPass::PresentPass(VulkanCore& vulkanCoreSupport, Image& sourceImage, Image& swapChainImage) : Pass(vulkanCoreSupport, { ResourceShaderInterface{ ResourceAccessSpecifier{&sourceImage, AccessSpecifier{AccessSpecifier::OPERATION::PREPARE_FOR_PRESENTATION, AccessSpecifier::STAGE::TRANSFER}}}, ResourceShaderInterface{ResourceAccessSpecifier{&swapChainImage, AccessSpecifier{AccessSpecifier::OPERATION::PRESENT, AccessSpecifier::STAGE::TRANSFER}}} }), sourceImage(sourceImage), swapChainImage(swapChainImage)
+PresentPass::PresentPass(VulkanCore& vulkanCoreSupport, Image& sourceImage, Image& swapChainImage, AccessSpecifier sourceImageAccess) : Pass(vulkanCoreSupport, { ResourceShaderInterface{ ResourceAccessSpecifier{&sourceImage, AccessSpecifier{AccessSpecifier::OPERATION::PREPARE_FOR_PRESENTATION, AccessSpecifier::STAGE::TRANSFER}}}, ResourceShaderInterface{ResourceAccessSpecifier{&swapChainImage, AccessSpecifier{AccessSpecifier::OPERATION::PRESENT, AccessSpecifier::STAGE::TRANSFER}}} }), sourceImage(sourceImage), swapChainImage(swapChainImage), sourceImageAccess(sourceImageAccess)
 {
 
 }
@@ -10,15 +10,11 @@ PresentPass::~PresentPass()
 
 }
 
-void PresentPass::prepareExecution(std::function<void(VkCommandBuffer, Pass*)> insertBarriers)
+void PresentPass::recordCommandBuffer(std::function<void(VkCommandBuffer, Pass*)> insertBarriers, uint32_t frameSlot)
 {
-	Pass::prepareExecution(insertBarriers);
-	recordCommandBuffer(insertBarriers);
-}
+	startCommandBufferRecording(insertBarriers, frameSlot);
 
-void PresentPass::recordCommandBuffer(std::function<void(VkCommandBuffer, Pass*)> insertBarriers)
-{
-	startCommandBufferRecording(insertBarriers);
+	VkCommandBuffer commandBuffer = commandBuffers.at(frameSlot);
 
 	swapChainImage.prepareForInitialAccess(commandBuffer, AccessSpecifier{ AccessSpecifier::OPERATION::TRANSFER_DESTINATION, AccessSpecifier::STAGE::TRANSFER });
 
@@ -36,7 +32,10 @@ void PresentPass::recordCommandBuffer(std::function<void(VkCommandBuffer, Pass*)
 
 	vkCmdBlitImage(commandBuffer, sourceImage.getImage(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, swapChainImage.getImage(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blitRegion, VK_FILTER_NEAREST);
 
-	swapChainImage.insertBarrier(commandBuffer, AccessSpecifier{ AccessSpecifier::OPERATION::TRANSFER_DESTINATION, AccessSpecifier::STAGE::TRANSFER }, AccessSpecifier{ AccessSpecifier::OPERATION::PRESENT, AccessSpecifier::STAGE::TRANSFER });
+	BarrierBatch batch;
+	swapChainImage.addBarrier(batch, { AccessSpecifier{ AccessSpecifier::OPERATION::TRANSFER_DESTINATION, AccessSpecifier::STAGE::TRANSFER } }, AccessSpecifier{ AccessSpecifier::OPERATION::PRESENT, AccessSpecifier::STAGE::TRANSFER });
+	sourceImage.addBarrier(batch, { AccessSpecifier{ AccessSpecifier::OPERATION::PREPARE_FOR_PRESENTATION, AccessSpecifier::STAGE::TRANSFER } }, sourceImageAccess);
+	batch.record(commandBuffer);
 
-	endCommandBufferRecording();
+	endCommandBufferRecording(frameSlot);
 }
\ No newline at end of file
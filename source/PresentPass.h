@@ -15,15 +15,16 @@ public:
 	* 
 	* @param sourceImage image to blit from
 	* @param swapChainImage image that is part of swap chain
+	* @param sourceImageAccess how sourceImage is last accessed before presentation. sourceImage is returned to its layout afterwards, so frames leave it in the same state whether or not they present
 	*/
-	PresentPass(VulkanCore& vulkanCoreSupport, Image& sourceImage, Image& swapChainImage);
+	PresentPass(VulkanCore& vulkanCoreSupport, Image& sourceImage, Image& swapChainImage, AccessSpecifier sourceImageAccess);
 	~PresentPass();
 
-	void prepareExecution(std::function<void(VkCommandBuffer, Pass*)> insertBarriers) override;
 
 private:
 	Image& sourceImage;
 	Image& swapChainImage;
+	AccessSpecifier sourceImageAccess;
 
-	void recordCommandBuffer(std::function<void(VkCommandBuffer, Pass*)> insertBarriers) override;
+	void recordCommandBuffer(std::function<void(VkCommandBuffer, Pass*)> insertBarriers, uint32_t frameSlot) override;
 };
\ No newline at end of file
@@ -1,6 +1,6 @@
 #include "PresentationController.h"
 
-PresentationController::PresentationController(VulkanCore& vulkanCoreSupport, Image& sampler) : vulkanCoreSupport(vulkanCoreSupport), swapChain(vulkanCoreSupport)
+PresentationController::PresentationController(VulkanCore& vulkanCoreSupport, Image& sampler, AccessSpecifier samplerAccess) : vulkanCoreSupport(vulkanCoreSupport), swapChain(vulkanCoreSupport)
 {
 	// get images
 	std::vector<VkImage> vulkanImages(swapChain.getNumImages());
@@ -23,7 +23,7 @@ PresentationController::PresentationController(VulkanCore& vulkanCoreSupport, Im
 	passes.reserve(swapChain.getNumImages());
 	for (size_t i = 0; i < swapChain.getNumImages(); i++)
 	{
-		passes.emplace_back(vulkanCoreSupport, sampler, images.at(i));
+		passes.emplace_back(vulkanCoreSupport, sampler, images.at(i), samplerAccess);
 	}
 			
 	createSyncObjects();
@@ -33,91 +33,75 @@ PresentationController::~PresentationController()
 {
 	VkDevice device = vulkanCoreSupport.getDevice();
 
-	for (size_t i = 0; i < swapChain.getNumImages(); i++)
+	for (VkSemaphore semaphore : renderFinishedSemaphores)
+	{
+		vkDestroySemaphore(device, semaphore, nullptr);
+	}
+	for (VkSemaphore semaphore : imageAvailableSemaphores)
 	{
-		vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
-		vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
-		vkDestroyFence(device, inFlightFences[i], nullptr);
+		vkDestroySemaphore(device, semaphore, nullptr);
 	}
 }
 
-void PresentationController::present()
+bool PresentationController::acquire(SubmitBatch& batch)
 {
 	VkDevice device = vulkanCoreSupport.getDevice();
+	uint32_t frameSlot = vulkanCoreSupport.getFrameSlot();
 
-	uint32_t imageIndex;
-	VkResult result = vkAcquireNextImageKHR(device, swapChain.getSwapChainObject(), UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+	VkResult result = vkAcquireNextImageKHR(device, swapChain.getSwapChainObject(), UINT64_MAX, imageAvailableSemaphores[frameSlot], VK_NULL_HANDLE, &acquiredImageIndex);
 
 	if (result == VK_ERROR_OUT_OF_DATE_KHR)
 	{
-		return;
+		return false;
 	}
 	else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
 	{
 		throw std::runtime_error("failed to acquire swap chain image");
 	}
 
-	vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
-	vkResetFences(device, 1, &inFlightFences[currentFrame]);
-
 	// copy complete frame into swapchain image
+	batch.commandBuffers = { passes[acquiredImageIndex].getCommandBuffer(frameSlot) };
+	batch.waitSemaphores = { imageAvailableSemaphores[frameSlot] };
+	batch.waitStages = { VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT };
+	batch.signalSemaphores = { renderFinishedSemaphores[acquiredImageIndex] };
 
-	VkSubmitInfo submitInfo{};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-
-	VkSemaphore waitSemaphores[] = { imageAvailableSemaphores[currentFrame] };
-	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT };
-	submitInfo.waitSemaphoreCount = 1;
-	submitInfo.pWaitSemaphores = waitSemaphores;
-	submitInfo.pWaitDstStageMask = waitStages;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &passes[currentFrame].getCommandBuffer();
-	
-	VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[currentFrame] };
-	submitInfo.signalSemaphoreCount = 1;
-	submitInfo.pSignalSemaphores = signalSemaphores;
-	   
-
-	if (vkQueueSubmit(vulkanCoreSupport.getGraphicsQueue(), 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS)
-	{
-		throw std::runtime_error("failed to submit draw command buffer");
-	}
-
-	// submit to present queue
+	return true;
+}
 
+void PresentationController::present()
+{
 	VkPresentInfoKHR presentInfo{};
 	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 
 	presentInfo.waitSemaphoreCount = 1;
-	presentInfo.pWaitSemaphores = signalSemaphores;
+	presentInfo.pWaitSemaphores = &renderFinishedSemaphores[acquiredImageIndex];
 
 	VkSwapchainKHR swapChains[] = { swapChain.getSwapChainObject() };
 	presentInfo.swapchainCount = 1;
 	presentInfo.pSwapchains = swapChains;
-	presentInfo.pImageIndices = &imageIndex;
+	presentInfo.pImageIndices = &acquiredImageIndex;
 
-	result = vkQueuePresentKHR(vulkanCoreSupport.getPresentQueue(), &presentInfo);
-
-	currentFrame = (currentFrame + 1) % swapChain.getNumImages();
+	vkQueuePresentKHR(vulkanCoreSupport.getPresentQueue(), &presentInfo);
 }
 
 void PresentationController::createSyncObjects()
 {
-	imageAvailableSemaphores.resize(swapChain.getNumImages());
+	imageAvailableSemaphores.resize(vulkanCoreSupport.getFramesInFlight());
 	renderFinishedSemaphores.resize(swapChain.getNumImages());
-	inFlightFences.resize(swapChain.getNumImages());
 	
 	VkSemaphoreCreateInfo semaphoreInfo{};
 	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-	VkFenceCreateInfo fenceInfo{};
-	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-	for (size_t i = 0; i < swapChain.getNumImages(); i++)
+	for (VkSemaphore& semaphore : imageAvailableSemaphores)
+	{
+		if (vkCreateSemaphore(vulkanCoreSupport.getDevice(), &semaphoreInfo, nullptr, &semaphore) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create synchronization objects");
+		}
+	}
+	for (VkSemaphore& semaphore : renderFinishedSemaphores)
 	{
-		if (vkCreateSemaphore(vulkanCoreSupport.getDevice(), &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS
-			|| vkCreateSemaphore(vulkanCoreSupport.getDevice(), &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS
-			|| vkCreateFence(vulkanCoreSupport.getDevice(), &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS)
+		if (vkCreateSemaphore(vulkanCoreSupport.getDevice(), &semaphoreInfo, nullptr, &semaphore) != VK_SUCCESS)
 		{
 			throw std::runtime_error("failed to create synchronization objects");
 		}
@@ -14,13 +14,25 @@ public:
 	* @brief Creates a PresentationController.
 	* 
 	* @param sampler image to display
+	* @param samplerAccess how sampler is last accessed in a frame
 	*/
-	PresentationController(VulkanCore& vulkanCoreSupport, Image& sampler);
+	PresentationController(VulkanCore& vulkanCoreSupport, Image& sampler, AccessSpecifier samplerAccess);
 
 	~PresentationController();
 
 	/**
-	* @brief Submits presentation commands to GPU.
+	* @brief Acquires the next swap chain image and fills batch with the commands copying the presented image into it.
+	* 
+	* batch waits for the image to be acquired and signals when the copy completes. It must be submitted after the passes rendering the presented image, and only once the previous submission of the current frame slot has completed.
+	* 
+	* @param batch variable to store commands and semaphores in
+	* 
+	* @return whether an image was acquired. If not, batch is left empty and present must not be called
+	*/
+	bool acquire(SubmitBatch& batch);
+
+	/**
+	* @brief Queues the image acquired by the last call to acquire for presentation. Assumes the batch returned by acquire has been submitted.
 	* 
 	*/
 	void present();
@@ -41,8 +53,9 @@ private:
 	std::vector<PresentPass> passes;
 
 	void createSyncObjects();
-	std::vector<VkFence> inFlightFences;
-	size_t currentFrame = 0;
+	uint32_t acquiredImageIndex = 0;
+	// one per frame slot. Reusable once the slot's previous submission completes
 	std::vector<VkSemaphore> imageAvailableSemaphores;
+	// one per swap chain image. Reusable once the image is acquired again, which implies its previous presentation completed
 	std::vector<VkSemaphore> renderFinishedSemaphores;
 };
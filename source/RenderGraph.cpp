@@ -0,0 +1,307 @@
+#include "RenderGraph.h"
+#include "DrawPass.h"
+#include "ClearPass.h"
+
+#include <algorithm>
+#include <queue>
+#include <unordered_map>
+#include <unordered_set>
+#include <stdexcept>
+
+RenderGraph::RenderGraph(const std::vector<Pass*>& passes, const std::vector<Resource*>& outputs) : passes(passes), dependencies(passes.size()), contributing(passes.size(), false), fused(passes.size(), false)
+{
+	deriveDependencies();
+	cullPasses(outputs);
+	fuseClearPasses();
+	sortPasses();
+	mergeSubpasses();
+}
+
+const std::vector<DependencyList>& RenderGraph::getSchedule() const
+{
+	return schedule;
+}
+
+const std::vector<Pass*>& RenderGraph::getCulledPasses() const
+{
+	return culledPasses;
+}
+
+void RenderGraph::deriveDependencies()
+{
+	// accesses to a resource since it was last modified
+	struct ResourceState
+	{
+		// pass that last wrote the resource or changed its layout. -1 if none has
+		int lastModifier = -1;
+		AccessSpecifier modifierAccess{ AccessSpecifier::OPERATION::NO_OPERATION, AccessSpecifier::STAGE::INITIAL };
+
+		// passes reading the resource since lastModifier. All read it in the same layout
+		std::vector<std::pair<size_t, AccessSpecifier>> readers;
+	};
+
+	std::unordered_map<Resource*, ResourceState> states;
+
+	for (size_t passIndex = 0; passIndex < passes.size(); passIndex++)
+	{
+		std::vector<ResourceAccessSpecifier> accesses;
+		passes.at(passIndex)->getResources(accesses);
+
+		for (const ResourceAccessSpecifier& access : accesses)
+		{
+			ResourceState& state = states[access.resource];
+
+			const AccessSpecifier& previousAccess = state.readers.empty() ? state.modifierAccess : state.readers.back().second;
+
+			// layout transitions happen in the barrier before an access, so they modify the resource like a write does
+			bool modifies = access.accessSpecifier.isWriteAccess() || access.resource->requiresLayoutTransition(previousAccess, access.accessSpecifier);
+
+			std::set<size_t>& passDependencies = dependencies.at(passIndex);
+
+			if (modifies)
+			{
+				if (!state.readers.empty())
+				{
+					// write-after-read. The readers already depend on lastModifier
+					for (const auto& reader : state.readers)
+					{
+						passDependencies.insert(reader.first);
+					}
+				}
+				else if (state.lastModifier >= 0)
+				{
+					// write-after-write
+					passDependencies.insert(static_cast<size_t>(state.lastModifier));
+				}
+
+				state.lastModifier = static_cast<int>(passIndex);
+				state.modifierAccess = access.accessSpecifier;
+				state.readers.clear();
+			}
+			else
+			{
+				// read-after-write. Reads don't depend on each other
+				if (state.lastModifier >= 0)
+				{
+					passDependencies.insert(static_cast<size_t>(state.lastModifier));
+				}
+
+				state.readers.push_back({ passIndex, access.accessSpecifier });
+			}
+
+			// a pass accessing a resource twice doesn't depend on itself
+			passDependencies.erase(passIndex);
+		}
+	}
+}
+
+void RenderGraph::cullPasses(const std::vector<Resource*>& outputs)
+{
+	std::unordered_set<Resource*> neededResources(outputs.begin(), outputs.end());
+
+	// walking backwards finds the passes a frame needs. Persistent resources read by them are needed from the previous frame, which may add passes, so repeat until nothing changes
+	bool changed = true;
+	while (changed)
+	{
+		changed = false;
+
+		std::unordered_set<Resource*> needed = neededResources;
+		for (size_t i = passes.size(); i-- > 0;)
+		{
+			std::vector<ResourceAccessSpecifier> accesses;
+			passes.at(i)->getResources(accesses);
+
+			bool writesNeededResource = false;
+			for (const ResourceAccessSpecifier& access : accesses)
+			{
+				writesNeededResource = writesNeededResource || (access.accessSpecifier.isWriteAccess() && needed.count(access.resource) > 0);
+			}
+
+			if (!writesNeededResource)
+			{
+				continue;
+			}
+
+			if (!contributing.at(i))
+			{
+				contributing.at(i) = true;
+				changed = true;
+			}
+
+			// whether a write covers the whole resource isn't known, so earlier writes to it are needed as well
+			for (const ResourceAccessSpecifier& access : accesses)
+			{
+				needed.insert(access.resource);
+			}
+		}
+
+		for (Resource* resource : needed)
+		{
+			if (!resource->isTransient())
+			{
+				neededResources.insert(resource);
+			}
+		}
+	}
+
+	culledPasses.clear();
+	for (size_t passIndex = 0; passIndex < passes.size(); passIndex++)
+	{
+		if (!contributing.at(passIndex))
+		{
+			culledPasses.push_back(passes.at(passIndex));
+		}
+	}
+}
+
+void RenderGraph::fuseClearPasses()
+{
+	for (size_t clearIndex = 0; clearIndex < passes.size(); clearIndex++)
+	{
+		ClearPass* clearPass = dynamic_cast<ClearPass*>(passes.at(clearIndex));
+		if (!clearPass || !contributing.at(clearIndex))
+		{
+			continue;
+		}
+
+		std::vector<size_t> successors;
+		for (size_t passIndex = clearIndex + 1; passIndex < passes.size(); passIndex++)
+		{
+			if (contributing.at(passIndex) && dependencies.at(passIndex).count(clearIndex) > 0)
+			{
+				successors.push_back(passIndex);
+			}
+		}
+
+		if (successors.size() != 1)
+		{
+			continue;
+		}
+
+		DrawPass* drawPass = dynamic_cast<DrawPass*>(passes.at(successors.front()));
+		if (!drawPass)
+		{
+			continue;
+		}
+
+		std::vector<ResourceAccessSpecifier> accesses;
+		drawPass->getResources(accesses);
+
+		bool drawsToImage = false;
+		for (const ResourceAccessSpecifier& access : accesses)
+		{
+			drawsToImage = drawsToImage || (access.resource == &clearPass->getImage() && access.accessSpecifier.operation == AccessSpecifier::OPERATION::COLOR_ATTACHMENT_OUTPUT);
+		}
+
+		if (!drawsToImage)
+		{
+			continue;
+		}
+
+		drawPass->clearAttachment(clearPass->getImage(), clearPass->getClearColor());
+
+		// the successor takes over the hazards of the ClearPass with earlier accesses to the Image
+		std::set<size_t>& successorDependencies = dependencies.at(successors.front());
+		successorDependencies.erase(clearIndex);
+		successorDependencies.insert(dependencies.at(clearIndex).begin(), dependencies.at(clearIndex).end());
+
+		fused.at(clearIndex) = true;
+	}
+}
+
+void RenderGraph::sortPasses()
+{
+	// culled and fused passes are left out. Contributing passes may still depend on culled ones through write-after-read hazards, which no longer exist without them
+	std::vector<bool> scheduled(passes.size());
+	for (size_t passIndex = 0; passIndex < passes.size(); passIndex++)
+	{
+		scheduled.at(passIndex) = contributing.at(passIndex) && !fused.at(passIndex);
+	}
+
+	for (size_t passIndex = 0; passIndex < passes.size(); passIndex++)
+	{
+		for (auto it = dependencies.at(passIndex).begin(); it != dependencies.at(passIndex).end();)
+		{
+			it = scheduled.at(*it) ? std::next(it) : dependencies.at(passIndex).erase(it);
+		}
+	}
+
+	std::vector<size_t> numUnscheduledDependencies(passes.size());
+	std::vector<std::vector<size_t>> dependents(passes.size());
+	for (size_t passIndex = 0; passIndex < passes.size(); passIndex++)
+	{
+		numUnscheduledDependencies.at(passIndex) = dependencies.at(passIndex).size();
+		for (size_t dependency : dependencies.at(passIndex))
+		{
+			dependents.at(dependency).push_back(passIndex);
+		}
+	}
+
+	// Kahn's algorithm. Ready passes are taken in declaration order so the result is deterministic
+	std::priority_queue<size_t, std::vector<size_t>, std::greater<size_t>> readyPasses;
+	for (size_t passIndex = 0; passIndex < passes.size(); passIndex++)
+	{
+		if (scheduled.at(passIndex) && numUnscheduledDependencies.at(passIndex) == 0)
+		{
+			readyPasses.push(passIndex);
+		}
+	}
+
+	schedule.clear();
+	while (!readyPasses.empty())
+	{
+		size_t passIndex = readyPasses.top();
+		readyPasses.pop();
+
+		DependencyList dependencyList{ passes.at(passIndex), {} };
+		for (size_t dependency : dependencies.at(passIndex))
+		{
+			dependencyList.dependenices.push_back(passes.at(dependency));
+		}
+		schedule.push_back(dependencyList);
+
+		for (size_t dependent : dependents.at(passIndex))
+		{
+			if (--numUnscheduledDependencies.at(dependent) == 0)
+			{
+				readyPasses.push(dependent);
+			}
+		}
+	}
+
+	if (schedule.size() != static_cast<size_t>(std::count(scheduled.begin(), scheduled.end(), true)))
+	{
+		throw std::runtime_error("render graph contains a dependency cycle");
+	}
+}
+
+void RenderGraph::mergeSubpasses()
+{
+	// chains only grow while each DrawPass directly follows the previous one in the schedule
+	std::vector<DrawPass*> chain;
+	auto mergeChain = [&chain]()
+	{
+		if (chain.size() > 1)
+		{
+			DrawPass::mergeSubpasses(chain);
+		}
+		chain.clear();
+	};
+
+	for (const DependencyList& dependencyList : schedule)
+	{
+		DrawPass* drawPass = dynamic_cast<DrawPass*>(dependencyList.pass);
+		if (drawPass && !chain.empty() && DrawPass::canMergeSubpass(chain, *drawPass))
+		{
+			chain.push_back(drawPass);
+			continue;
+		}
+
+		mergeChain();
+		if (drawPass)
+		{
+			chain.push_back(drawPass);
+		}
+	}
+	mergeChain();
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <vector>
+#include <set>
+
+#include "Pass.h"
+#include "PassDependencyManager.h"
+
+/**
+* @brief Compiler deriving the dependencies between passes from the resources they declare.
+*
+* Passes are supplied in declaration order. Accesses to the same resource take effect in declaration order, so a pass reading a resource sees the most recently declared write to it. Passes that share no hazard are unordered with respect to each other.
+*
+* Consecutive DrawPasses in the execution order that read each other's attachments as input attachments are merged into subpasses of one render pass.
+*
+* A ClearPass whose only successor draws to the cleared Image is fused into it, so the render pass clears the attachment when it begins instead.
+*
+* Passes that don't contribute to any output are culled. A pass contributes if it writes a resource that is an output, or that a contributing pass accesses later in the frame. Persistent resources read by contributing passes are needed from the previous frame too.
+*/
+class RenderGraph
+{
+public:
+
+	/**
+	* @brief Compiles passes into an execution order and the dependencies between them.
+	*
+	* @param passes passes in declaration order
+	* @param outputs resources whose content is used after the passes complete, e.g. the presented image
+	*/
+	RenderGraph(const std::vector<Pass*>& passes, const std::vector<Resource*>& outputs);
+
+	/**
+	* @brief Returns the compiled passes in execution order.
+	*
+	* Each pass depends only on the passes it has a read-after-write, write-after-read or write-after-write hazard with, and for each resource only on its nearest conflicting accesses.
+	*
+	* @return dependency lists in execution order
+	*/
+	const std::vector<DependencyList>& getSchedule() const;
+
+	/**
+	* @brief Returns the passes that were culled because they don't contribute to any output.
+	*
+	* @return culled passes in declaration order
+	*/
+	const std::vector<Pass*>& getCulledPasses() const;
+
+private:
+
+	// passes in declaration order
+	std::vector<Pass*> passes;
+
+	// declaration indices of the passes each pass depends on
+	std::vector<std::set<size_t>> dependencies;
+
+	// whether each pass contributes to an output
+	std::vector<bool> contributing;
+
+	std::vector<Pass*> culledPasses;
+
+	// whether each pass was fused into a successor, and so isn't scheduled
+	std::vector<bool> fused;
+
+	std::vector<DependencyList> schedule;
+
+	void deriveDependencies();
+	void cullPasses(const std::vector<Resource*>& outputs);
+	void fuseClearPasses();
+	void sortPasses();
+	void mergeSubpasses();
+};
@@ -1,5 +1,7 @@
 #include "Resource.h"
 
+#include <algorithm>
+
 const std::unordered_map<Resource::ACCESS_PROPERTY, VkMemoryPropertyFlags> Resource::MEMORY_PROPERTY_FLAGS =
 {
 	{Resource::ACCESS_PROPERTY::CPU_PREFERRED, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT},
@@ -12,6 +14,7 @@ const std::unordered_map<AccessSpecifier::OPERATION, VkDescriptorType> Resource:
 	{AccessSpecifier::OPERATION::DEPTH_SAMPLER, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER},
 	{AccessSpecifier::OPERATION::COLOR_SAMPLER, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER},
 	{AccessSpecifier::OPERATION::SHADER_STORAGE_IMAGE, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE},
+	{AccessSpecifier::OPERATION::INPUT_ATTACHMENT, VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT},
 
 	{AccessSpecifier::OPERATION::UNIFORM_BUFFER, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER},
 	{AccessSpecifier::OPERATION::SHADER_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER}
@@ -36,6 +39,7 @@ const std::unordered_map<AccessSpecifier::OPERATION, VkAccessFlags> Resource::AC
 	{AccessSpecifier::OPERATION::VERTEX_BUFFER, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT},
 	{AccessSpecifier::OPERATION::INDEX_BUFFER, VK_ACCESS_INDEX_READ_BIT},
 	{AccessSpecifier::OPERATION::UNIFORM_BUFFER, VK_ACCESS_UNIFORM_READ_BIT},
+	{AccessSpecifier::OPERATION::INPUT_ATTACHMENT, VK_ACCESS_INPUT_ATTACHMENT_READ_BIT},
 	{AccessSpecifier::OPERATION::COLOR_ATTACHMENT_OUTPUT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT},
 	{AccessSpecifier::OPERATION::SHADER_STORAGE_BUFFER, VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT},
 	{AccessSpecifier::OPERATION::DEPTH_BUFFER, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT},
@@ -46,7 +50,8 @@ const std::unordered_map<AccessSpecifier::OPERATION, VkAccessFlags> Resource::AC
 
 const std::unordered_map<AccessSpecifier::STAGE, VkPipelineStageFlagBits> Resource::PIPELINE_STAGE_FLAGS
 {
-	{AccessSpecifier::STAGE::INITIAL, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT},
+	// with several frames in flight the previous frame may still access the resource, so initial accesses wait for all prior work
+	{AccessSpecifier::STAGE::INITIAL, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT},
 	{AccessSpecifier::STAGE::VERTEX_SHADER, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT},
 	{AccessSpecifier::STAGE::FRAGMENT_SHADER, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT},
 	{AccessSpecifier::STAGE::COMPUTE_SHADER, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT},
@@ -54,25 +59,87 @@ const std::unordered_map<AccessSpecifier::STAGE, VkPipelineStageFlagBits> Resour
 	{AccessSpecifier::STAGE::FINAL, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT}
 };
 
-Resource::Resource(VulkanCore& vulkanCoreSupport) : vulkanCoreSupport(vulkanCoreSupport)
+Resource::Resource(VulkanCore& vulkanCoreSupport) : vulkanCoreSupport(vulkanCoreSupport), lastUseSubmissions(vulkanCoreSupport.getFramesInFlight(), 0)
 {
 
 }
 
-void Resource::registerResourceUse(const VkFence& passFence, AccessSpecifier accessSpecifier)
+void Resource::registerResourceUse(AccessSpecifier accessSpecifier)
 {
-	notInUseFences.push_back(passFence);
 	accessTypes.insert(accessSpecifier.operation);
 }
 
+void Resource::registerSubmission(uint64_t submissionValue, uint32_t frameSlot)
+{
+	lastUseSubmissions.at(frameSlot) = std::max(lastUseSubmissions.at(frameSlot), submissionValue);
+}
+
+void Resource::prepareForFrame(uint32_t frameSlot)
+{
+}
+
 void Resource::waitForReady() const
 {
-	if (notInUseFences.size() > 0)
+	vulkanCoreSupport.waitForSubmission(getLastUseSubmission());
+}
+
+void Resource::waitForReady(uint32_t frameSlot) const
+{
+	vulkanCoreSupport.waitForSubmission(getLastUseSubmission(frameSlot));
+}
+
+uint64_t Resource::getLastUseSubmission() const
+{
+	return *std::max_element(lastUseSubmissions.begin(), lastUseSubmissions.end());
+}
+
+uint64_t Resource::getLastUseSubmission(uint32_t frameSlot) const
+{
+	return lastUseSubmissions.at(frameSlot);
+}
+
+void Resource::insertBarrier(VkCommandBuffer& commandBuffer, AccessSpecifier previousAccess, AccessSpecifier currentAccess)
+{
+	insertBarrier(commandBuffer, std::vector<AccessSpecifier>{ previousAccess }, currentAccess);
+}
+
+void Resource::insertBarrier(VkCommandBuffer& commandBuffer, const std::vector<AccessSpecifier>& previousAccesses, AccessSpecifier currentAccess)
+{
+	BarrierBatch batch;
+	addBarrier(batch, previousAccesses, currentAccess);
+	batch.record(commandBuffer);
+}
+
+bool Resource::requiresLayoutTransition(const AccessSpecifier& previousAccess, const AccessSpecifier& currentAccess) const
+{
+	return false;
+}
+
+bool Resource::isTransient() const
+{
+	return false;
+}
+
+VkDescriptorType Resource::getDescriptorType(AccessSpecifier::OPERATION operation) const
+{
+	return DESCRIPTOR_TYPES.at(operation);
+}
+
+bool Resource::getDynamicOffset(uint32_t block, uint32_t frameSlot, uint32_t& offset) const
+{
+	return false;
+}
+
+const AccessSpecifier& Resource::getInitialAccess() const
+{
+	return initialAccess;
+}
+
+void Resource::load()
+{
+	if (loadFunction)
 	{
-		if (vkWaitForFences(vulkanCoreSupport.getDevice(), static_cast<uint32_t>(notInUseFences.size()), notInUseFences.data(), VK_TRUE, UINT64_MAX) != VK_SUCCESS)
-		{
-			throw std::runtime_error("wait for fence timeout");
-		}
+		loadFunction();
 	}
 }
 
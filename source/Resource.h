@@ -3,6 +3,7 @@
 #include <functional>
 #include "VulkanCore.h"
 #include "AccessSpecifier.h"
+#include "BarrierBatch.h"
 
 /**
 * @brief Representation of GPU-accessible memory. Provides functions wrapping GPU API functions: resource initialization, synchronization, etc.
@@ -49,9 +50,10 @@ public:
 	* @param index binding of the descriptor
 	* @param access description of how descriptor is accessed
 	* @param descriptorSet VkDescriptorSet to record write to
+	* @param frameSlot frame slot the descriptor set is used in
 	* @param out result
 	*/
-	virtual void createDescriptorWrite(int index, AccessSpecifier access, const VkDescriptorSet& descriptorSet, VkWriteDescriptorSet& out) const = 0;
+	virtual void createDescriptorWrite(int index, AccessSpecifier access, const VkDescriptorSet& descriptorSet, uint32_t frameSlot, VkWriteDescriptorSet& out) const = 0;
 
 
 	/**
@@ -69,15 +71,109 @@ public:
 	* @param previousAccess how this Resource is accessed before this access
 	* @param currentAccess how this Resource is accessed
 	*/
-	virtual void insertBarrier(VkCommandBuffer& commandBuffer, AccessSpecifier previousAccess, AccessSpecifier currentAccess) = 0;
+	void insertBarrier(VkCommandBuffer& commandBuffer, AccessSpecifier previousAccess, AccessSpecifier currentAccess);
 
 	/**
-	* @brief Notifies this Resource that it is used as in accessSpecifier. Ensures that the host will not update this resource while used by GPU.
+	* @brief Inserts a barrier to commandBuffer that waits for several unordered previous accesses, such as reads from different passes.
+	*
+	* @param commandBuffer command buffer to record to
+	* @param previousAccesses how this Resource is accessed before this access. Must not be empty and must not require different layouts
+	* @param currentAccess how this Resource is accessed
+	*/
+	void insertBarrier(VkCommandBuffer& commandBuffer, const std::vector<AccessSpecifier>& previousAccesses, AccessSpecifier currentAccess);
+
+	/**
+	* @brief Adds the barrier between previousAccesses and currentAccess to batch instead of recording it directly, so barriers of several resources can be recorded together.
+	*
+	* @param batch batch to add the barrier to
+	* @param previousAccesses how this Resource is accessed before this access. Must not be empty and must not require different layouts
+	* @param currentAccess how this Resource is accessed
+	* @param discardContent whether the current content may be discarded, e.g. because another Resource used the same memory. previousAccesses then describe the accesses to wait for, not the layout
+	*/
+	virtual void addBarrier(BarrierBatch& batch, const std::vector<AccessSpecifier>& previousAccesses, AccessSpecifier currentAccess, bool discardContent = false) = 0;
+
+	/**
+	* @brief Returns whether changing from previousAccess to currentAccess changes the layout of this Resource's memory. A layout change modifies the Resource even if neither access writes to it.
+	*
+	* @param previousAccess how this Resource is accessed before
+	* @param currentAccess how this Resource is accessed after
+	* @return whether a layout transition is required
+	*/
+	virtual bool requiresLayoutTransition(const AccessSpecifier& previousAccess, const AccessSpecifier& currentAccess) const;
+
+	/**
+	* @brief Returns whether the content of this Resource is discarded between frames, so its first access in a frame doesn't depend on earlier frames.
+	*
+	* @return whether this Resource is transient
+	*/
+	virtual bool isTransient() const;
+
+	/**
+	* @brief Returns the descriptor type shaders use to access this Resource with operation.
+	*
+	* @param operation how shaders access this Resource
+	* @return descriptor type
+	*/
+	virtual VkDescriptorType getDescriptorType(AccessSpecifier::OPERATION operation) const;
+
+	/**
+	* @brief Returns the dynamic offset to bind this Resource's descriptor with, for descriptor types that take one.
+	*
+	* @param block part of this Resource shaders read, see ResourceShaderInterface::uniformBlock
+	* @param frameSlot frame slot the descriptor set is bound in
+	* @param offset set to the dynamic offset in bytes
+	* @return false if the descriptor doesn't take a dynamic offset, in which case offset is left unchanged
+	*/
+	virtual bool getDynamicOffset(uint32_t block, uint32_t frameSlot, uint32_t& offset) const;
+
+	/**
+	* @brief Returns how this Resource was last accessed before passes execute, e.g. by an upload during initialization. Describes the layout its content is in.
+	*
+	* @return initial access. NO_OPERATION if the content is undefined
+	*/
+	const AccessSpecifier& getInitialAccess() const;
+
+	/**
+	* @brief Notifies this Resource that it is used as in accessSpecifier. Must be called before initialize.
 	* 
-	* @param passFence fence signaling whether a pass is running
 	* @param accessSpecifier how this Resource is accessed.
 	*/
-	void registerResourceUse(const VkFence& passFence, AccessSpecifier accessSpecifier);
+	void registerResourceUse(AccessSpecifier accessSpecifier);
+
+	/**
+	* @brief Notifies this Resource that a submission uses it. Ensures that the host will not update this resource while used by GPU.
+	* 
+	* @param submissionValue value returned by VulkanCore::submitCommandBuffers for the submission
+	* @param frameSlot frame slot the submission was made in
+	*/
+	void registerSubmission(uint64_t submissionValue, uint32_t frameSlot);
+
+	/**
+	* @brief Gets the most recent submission using this Resource, in any frame slot.
+	*
+	* @return submission value, 0 if none
+	*/
+	uint64_t getLastUseSubmission() const;
+
+	/**
+	* @brief Gets the most recent submission made in frameSlot using this Resource.
+	*
+	* @param frameSlot frame slot to get the submission of
+	* @return submission value, 0 if none
+	*/
+	uint64_t getLastUseSubmission(uint32_t frameSlot) const;
+
+	/**
+	* @brief Notifies this Resource that a frame is about to be submitted in frameSlot, once the frame last submitted in that slot has completed. Lets the Resource bring the data the frame slot uses up to date.
+	*
+	* @param frameSlot frame slot of the frame
+	*/
+	virtual void prepareForFrame(uint32_t frameSlot);
+
+	/**
+	* @brief Performs the host-side work of initialization that doesn't use the GPU, such as decoding files. May run on a worker thread while other Resources load. Must be called before initialize.
+	*/
+	void load();
 
 	/**
 	* @brief Prepares this Resource for use. Must be called after all passes have registered and before execution begins.
@@ -125,22 +221,39 @@ protected:
 	*/
 	virtual void waitForReady() const;
 
+	/**
+	* @brief blocks until no submission made in frameSlot uses this Resource. Sufficient for data only read by frames in that slot.
+	*
+	* @param frameSlot frame slot to wait for
+	*/
+	void waitForReady(uint32_t frameSlot) const;
+
 	/**
 	* @brief Operations the user has declared to use on this Resource.
 	*/
 	std::set<AccessSpecifier::OPERATION> accessTypes;
 
+	/**
+	* @brief Function doing the host-side work of initialization. Must not use VulkanCore. Optional
+	*/
+	std::function<void()> loadFunction;
+
 	/**
 	* @brief Function to initialize this Resource with.
 	*/
 	std::function<void()> initializeFunction;
 
+	/**
+	* @brief How this Resource was last accessed before passes execute. Set by commands that fill this Resource during initialization.
+	*/
+	AccessSpecifier initialAccess{ AccessSpecifier::OPERATION::NO_OPERATION, AccessSpecifier::STAGE::INITIAL };
+
 	VulkanCore& getVulkanCoreSupport() const;
 
 private:
 
 	VulkanCore& vulkanCoreSupport;
 
-	// each elements represents whether a command buffer that uses this Resource is not in the queue. Used to synchronize host writes
-	std::vector<VkFence> notInUseFences;
+	// most recent submission per frame slot that uses this Resource. Used to synchronize host writes
+	std::vector<uint64_t> lastUseSubmissions;
 };
@@ -40,6 +40,11 @@ struct ResourceShaderInterface
 	*/
 	bool blendEnabled = false;
 
+	/**
+	* @brief block of a UniformAllocator the shader reads. Ignored by other resources
+	*/
+	uint32_t uniformBlock = 0;
+
 	/**
 	* @brief Returns whether described resource is a descriptor.
 	* 
@@ -50,3 +55,21 @@ struct ResourceShaderInterface
 		return descriptorBinding >= 0;
 	}
 };
+
+/**
+* @brief Description of how the content of a resource accessed by a pass relates to the other accesses in a frame.
+*
+* Defaults assume the content matters both ways, which is always correct.
+*/
+struct ResourceContentUse
+{
+	/**
+	* @brief whether the resource holds data written before the access, by an earlier pass, an earlier frame or an upload
+	*/
+	bool previousContentDefined = true;
+
+	/**
+	* @brief whether the data is used after the access, by a later pass, a later frame or outside the passes
+	*/
+	bool contentUsedLater = true;
+};
@@ -0,0 +1,103 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(uint32_t numThreads)
+{
+	threads.reserve(numThreads);
+	for (uint32_t i = 0; i < numThreads; i++)
+	{
+		threads.emplace_back(&ThreadPool::work, this, i);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	workAvailable.notify_all();
+
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+}
+
+uint32_t ThreadPool::getNumThreads() const
+{
+	return static_cast<uint32_t>(threads.size());
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t, uint32_t)>& function)
+{
+	if (count == 0)
+	{
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(mutex);
+
+	currentFunction = &function;
+	this->count = count;
+	nextIndex = 0;
+	completed = 0;
+	error = nullptr;
+	generation++;
+
+	workAvailable.notify_all();
+	workFinished.wait(lock, [this]() { return completed == this->count; });
+
+	currentFunction = nullptr;
+
+	if (error)
+	{
+		std::rethrow_exception(error);
+	}
+}
+
+void ThreadPool::work(uint32_t threadIndex)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	uint64_t finishedGeneration = 0;
+
+	while (true)
+	{
+		workAvailable.wait(lock, [this, &finishedGeneration]() { return stopping || (generation != finishedGeneration && nextIndex < count); });
+
+		if (stopping)
+		{
+			return;
+		}
+
+		// claim indices until none are left. Other workers claim the rest concurrently
+		while (nextIndex < count)
+		{
+			size_t index = nextIndex++;
+			lock.unlock();
+
+			std::exception_ptr callError;
+			try
+			{
+				(*currentFunction)(index, threadIndex);
+			}
+			catch (...)
+			{
+				callError = std::current_exception();
+			}
+
+			lock.lock();
+
+			if (callError && !error)
+			{
+				error = callError;
+			}
+
+			if (++completed == count)
+			{
+				workFinished.notify_all();
+			}
+		}
+
+		finishedGeneration = generation;
+	}
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+
+/**
+* @brief Fixed set of worker threads executing independent pieces of work.
+*
+* Used to spread thread-safe GPU API work such as pipeline creation across cores.
+*/
+class ThreadPool
+{
+public:
+
+	/**
+	* @brief Creates a ThreadPool and starts its worker threads.
+	*
+	* @param numThreads number of worker threads
+	*/
+	ThreadPool(uint32_t numThreads);
+
+	/**
+	* @brief Stops and joins all worker threads.
+	*/
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool(ThreadPool&&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+	ThreadPool& operator=(ThreadPool&&) = delete;
+
+	/**
+	* @brief Returns the number of worker threads.
+	*
+	* @return number of worker threads
+	*/
+	uint32_t getNumThreads() const;
+
+	/**
+	* @brief Calls function once for every index in [0, count) on the worker threads and blocks until all calls return.
+	*
+	* Must not be called from a worker thread or from several threads at once. If any call throws, the first exception is rethrown once all calls have returned.
+	*
+	* @param count number of calls
+	* @param function function receiving the index of the call and the index of the worker thread executing it
+	*/
+	void parallelFor(size_t count, const std::function<void(size_t, uint32_t)>& function);
+
+private:
+
+	std::vector<std::thread> threads;
+
+	std::mutex mutex;
+	std::condition_variable workAvailable;
+	std::condition_variable workFinished;
+
+	// state of the current parallelFor call. Guarded by mutex
+	const std::function<void(size_t, uint32_t)>* currentFunction = nullptr;
+	size_t count = 0;
+	size_t nextIndex = 0;
+	size_t completed = 0;
+	uint64_t generation = 0;
+	std::exception_ptr error;
+
+	bool stopping = false;
+
+	void work(uint32_t threadIndex);
+};
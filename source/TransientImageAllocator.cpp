@@ -0,0 +1,162 @@
+#include "TransientImageAllocator.h"
+
+#include <unordered_map>
+#include <algorithm>
+
+TransientImageAllocator::TransientImageAllocator(VulkanCore& vulkanCoreSupport, const std::vector<Pass*>& passes, Image* presentedImage) : vulkanCoreSupport(vulkanCoreSupport)
+{
+	// indices of the first and last pass accessing an Image
+	struct Lifetime
+	{
+		size_t first;
+		size_t last;
+	};
+
+	std::vector<Image*> images;
+	std::unordered_map<Image*, Lifetime> lifetimes;
+
+	// passes merged into the one before them execute at the same time, so they share an index
+	size_t passIndex = 0;
+	for (size_t i = 0; i < passes.size(); i++)
+	{
+		if (i > 0 && passes.at(i)->getRecordingPass() == passes.at(i))
+		{
+			passIndex++;
+		}
+
+		std::vector<ResourceAccessSpecifier> accesses;
+		passes.at(i)->getResources(accesses);
+
+		for (const ResourceAccessSpecifier& access : accesses)
+		{
+			if (!access.resource->isTransient())
+			{
+				continue;
+			}
+
+			// only Images are transient
+			Image* image = static_cast<Image*>(access.resource);
+			if (lifetimes.count(image) == 0)
+			{
+				images.push_back(image);
+				lifetimes[image] = Lifetime{ passIndex, passIndex };
+			}
+			lifetimes.at(image).last = passIndex;
+		}
+	}
+
+	if (lifetimes.count(presentedImage) > 0)
+	{
+		lifetimes.at(presentedImage).last = passes.size();
+	}
+
+	// Images sharing memory, in order of their lifetimes
+	struct MemoryGroup
+	{
+		std::vector<Image*> images;
+		VkMemoryRequirements memoryRequirements;
+	};
+
+	std::vector<MemoryGroup> groups;
+
+	VmaAllocationCreateInfo lazyAllocationInfo{};
+	lazyAllocationInfo.usage = VMA_MEMORY_USAGE_GPU_LAZILY_ALLOCATED;
+
+	// images is in order of first access. Each Image joins the group that grows least among those whose last Image is dead by then
+	for (Image* image : images)
+	{
+		VkMemoryRequirements memoryRequirements = image->getMemoryRequirements();
+		requiredBytes += memoryRequirements.size;
+
+		// lazily allocated memory is only committed if the attachment leaves tile memory, so there's little to gain from sharing it
+		uint32_t memoryTypeIndex;
+		if (image->isTransientAttachment() && vmaFindMemoryTypeIndex(vulkanCoreSupport.getVmaAllocator(), memoryRequirements.memoryTypeBits, &lazyAllocationInfo, &memoryTypeIndex) == VK_SUCCESS)
+		{
+			VmaAllocation allocation;
+			if (vmaAllocateMemory(vulkanCoreSupport.getVmaAllocator(), &memoryRequirements, &lazyAllocationInfo, &allocation, nullptr) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to allocate transient image memory");
+			}
+			allocations.push_back(allocation);
+			lazilyAllocatedBytes += memoryRequirements.size;
+
+			image->bindMemory(allocation, image);
+			continue;
+		}
+
+		MemoryGroup* bestGroup = nullptr;
+		VkDeviceSize bestGrowth = 0;
+		for (MemoryGroup& group : groups)
+		{
+			bool lifetimesOverlap = lifetimes.at(group.images.back()).last >= lifetimes.at(image).first;
+			bool memoryTypeCompatible = (group.memoryRequirements.memoryTypeBits & memoryRequirements.memoryTypeBits) != 0;
+			if (lifetimesOverlap || !memoryTypeCompatible)
+			{
+				continue;
+			}
+
+			VkDeviceSize growth = memoryRequirements.size > group.memoryRequirements.size ? memoryRequirements.size - group.memoryRequirements.size : 0;
+			if (!bestGroup || growth < bestGrowth)
+			{
+				bestGroup = &group;
+				bestGrowth = growth;
+			}
+		}
+
+		if (!bestGroup)
+		{
+			groups.push_back(MemoryGroup{ { image }, memoryRequirements });
+			continue;
+		}
+
+		bestGroup->images.push_back(image);
+		bestGroup->memoryRequirements.size = std::max(bestGroup->memoryRequirements.size, memoryRequirements.size);
+		bestGroup->memoryRequirements.alignment = std::max(bestGroup->memoryRequirements.alignment, memoryRequirements.alignment);
+		bestGroup->memoryRequirements.memoryTypeBits &= memoryRequirements.memoryTypeBits;
+	}
+
+	VmaAllocationCreateInfo allocationInfo{};
+	allocationInfo.preferredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+	allocationInfo.flags = VMA_ALLOCATION_CREATE_CAN_ALIAS_BIT;
+
+	for (const MemoryGroup& group : groups)
+	{
+		VmaAllocation allocation;
+		if (vmaAllocateMemory(vulkanCoreSupport.getVmaAllocator(), &group.memoryRequirements, &allocationInfo, &allocation, nullptr) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to allocate transient image memory");
+		}
+		allocations.push_back(allocation);
+		allocatedBytes += group.memoryRequirements.size;
+
+		// frames repeat, so the first Image of a group follows the last one of the previous frame
+		for (size_t i = 0; i < group.images.size(); i++)
+		{
+			Image* precedingAlias = group.images.at((i + group.images.size() - 1) % group.images.size());
+			group.images.at(i)->bindMemory(allocation, precedingAlias);
+		}
+	}
+}
+
+TransientImageAllocator::~TransientImageAllocator()
+{
+	for (VmaAllocation allocation : allocations)
+	{
+		vmaFreeMemory(vulkanCoreSupport.getVmaAllocator(), allocation);
+	}
+}
+
+VkDeviceSize TransientImageAllocator::getRequiredBytes() const
+{
+	return requiredBytes;
+}
+
+VkDeviceSize TransientImageAllocator::getAllocatedBytes() const
+{
+	return allocatedBytes;
+}
+
+VkDeviceSize TransientImageAllocator::getLazilyAllocatedBytes() const
+{
+	return lazilyAllocatedBytes;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vector>
+
+#include "Pass.h"
+
+/**
+* @brief Owner of the memory shared by transient Images.
+*
+* Each transient Image is live from its first to its last access in the execution order. Images whose lifetimes don't overlap are bound to the same memory. Barriers between Images sharing memory are inserted by PassDependencyManager, using Image::getPrecedingAlias.
+*
+* Transient attachments get lazily allocated memory of their own where the device supports it.
+*/
+class TransientImageAllocator
+{
+public:
+
+	/**
+	* @brief Binds every transient Image accessed by passes to memory, sharing memory between Images whose lifetimes don't overlap.
+	*
+	* Images must be initialized.
+	*
+	* @param passes passes in execution order
+	* @param presentedImage Image read after the passes complete, e.g. by presentation. It stays live until the end of the frame
+	*/
+	TransientImageAllocator(VulkanCore& vulkanCoreSupport, const std::vector<Pass*>& passes, Image* presentedImage);
+
+	/**
+	* @brief Frees the shared memory. Images bound to it must not be used afterwards.
+	*/
+	~TransientImageAllocator();
+
+	TransientImageAllocator(const TransientImageAllocator&) = delete;
+	TransientImageAllocator& operator=(const TransientImageAllocator&) = delete;
+
+	/**
+	* @brief Returns the memory transient Images would use with an allocation each.
+	*
+	* @return size in bytes
+	*/
+	VkDeviceSize getRequiredBytes() const;
+
+	/**
+	* @brief Returns the memory allocated for transient Images.
+	*
+	* @return size in bytes
+	*/
+	VkDeviceSize getAllocatedBytes() const;
+
+	/**
+	* @brief Returns the memory allocated lazily for transient attachments, which the device only commits if needed. Not included in getAllocatedBytes.
+	*
+	* @return size in bytes
+	*/
+	VkDeviceSize getLazilyAllocatedBytes() const;
+
+private:
+
+	VulkanCore& vulkanCoreSupport;
+
+	// one allocation per group of Images sharing memory
+	std::vector<VmaAllocation> allocations;
+
+	VkDeviceSize requiredBytes = 0;
+	VkDeviceSize allocatedBytes = 0;
+	VkDeviceSize lazilyAllocatedBytes = 0;
+};
@@ -0,0 +1,141 @@
+#include "UniformAllocator.h"
+#include <stdexcept>
+
+UniformAllocator::UniformAllocator(VulkanCore& vulkanCoreSupport, VkDeviceSize blockSize, uint32_t maxBlocks) : blockSize(blockSize), maxBlocks(maxBlocks), Resource(vulkanCoreSupport)
+{
+	initializeFunction = [this]()
+	{
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(getVulkanCoreSupport().getPhysicalDevice(), &properties);
+
+		VkDeviceSize alignment = properties.limits.minUniformBufferOffsetAlignment;
+		blockStride = (this->blockSize + alignment - 1) / alignment * alignment;
+
+		VkBufferCreateInfo bufferInfo{};
+		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		bufferInfo.size = blockStride * this->maxBlocks * getVulkanCoreSupport().getFramesInFlight();
+		bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+		// resources used on several queues are shared concurrently instead of transferring ownership between them
+		std::vector<uint32_t> queueFamilyIndices = getVulkanCoreSupport().getResourceQueueFamilyIndices();
+		bufferInfo.sharingMode = queueFamilyIndices.size() > 1 ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE;
+		bufferInfo.queueFamilyIndexCount = static_cast<uint32_t>(queueFamilyIndices.size());
+		bufferInfo.pQueueFamilyIndices = queueFamilyIndices.data();
+
+		VmaAllocationCreateInfo allocationInfo{};
+		allocationInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+		allocationInfo.usage = VMA_MEMORY_USAGE_AUTO;
+
+		VmaAllocationInfo allocationResult{};
+		if (vmaCreateBuffer(getVulkanCoreSupport().getVmaAllocator(), &bufferInfo, &allocationInfo, &buffer, &allocation, &allocationResult) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create uniform buffer");
+		}
+
+		mappedData = static_cast<uint8_t*>(allocationResult.pMappedData);
+	};
+}
+
+UniformAllocator::~UniformAllocator()
+{
+	if (buffer != VK_NULL_HANDLE)
+	{
+		vmaDestroyBuffer(getVulkanCoreSupport().getVmaAllocator(), buffer, allocation);
+	}
+}
+
+uint32_t UniformAllocator::allocate()
+{
+	if (numBlocks == maxBlocks)
+	{
+		throw std::runtime_error("uniform allocator is full");
+	}
+
+	return numBlocks++;
+}
+
+void UniformAllocator::flush(uint32_t block)
+{
+	if (buffer == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	vmaFlushAllocation(getVulkanCoreSupport().getVmaAllocator(), allocation, getBlockOffset(block, getVulkanCoreSupport().getFrameSlot()), blockSize);
+}
+
+VkDeviceSize UniformAllocator::getBlockOffset(uint32_t block, uint32_t frameSlot) const
+{
+	if (block >= numBlocks)
+	{
+		throw std::runtime_error("uniform block not allocated");
+	}
+
+	// the blocks of a frame slot are contiguous, so frames only wait for their own slot
+	return (static_cast<VkDeviceSize>(frameSlot) * maxBlocks + block) * blockStride;
+}
+
+void* UniformAllocator::getMappedData(uint32_t block)
+{
+	// an allocator used only by culled passes is never created, so there's nothing to write
+	if (buffer == VK_NULL_HANDLE)
+	{
+		return nullptr;
+	}
+
+	uint32_t frameSlot = getVulkanCoreSupport().getFrameSlot();
+	waitForReady(frameSlot);
+
+	return mappedData + getBlockOffset(block, frameSlot);
+}
+
+void UniformAllocator::createLayoutBinding(int index, AccessSpecifier access, VkDescriptorSetLayoutBinding& out) const
+{
+	out.binding = index;
+	out.descriptorType = getDescriptorType(access.operation);
+	out.descriptorCount = 1;
+	out.stageFlags = STAGE_FLAGS.at(access.stage);
+	out.pImmutableSamplers = nullptr;
+}
+
+void UniformAllocator::createDescriptorWrite(int index, AccessSpecifier access, const VkDescriptorSet& descriptorSet, uint32_t frameSlot, VkWriteDescriptorSet& out) const
+{
+	// the dynamic offset selects the block
+	VkDescriptorBufferInfo descriptorBufferInfo{};
+	descriptorBufferInfo.buffer = buffer;
+	descriptorBufferInfo.offset = 0;
+	descriptorBufferInfo.range = blockSize;
+
+	out.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	out.dstSet = descriptorSet;
+	out.dstBinding = index;
+	out.dstArrayElement = 0;
+	out.descriptorType = getDescriptorType(access.operation);
+	out.descriptorCount = 1;
+	out.pBufferInfo = &descriptorBufferInfo;
+	out.pImageInfo = nullptr;
+	out.pTexelBufferView = nullptr;
+	out.pNext = nullptr;
+
+	vkUpdateDescriptorSets(getVulkanCoreSupport().getDevice(), 1, &out, 0, nullptr);
+}
+
+void UniformAllocator::prepareForInitialAccess(VkCommandBuffer& commandBuffer, AccessSpecifier currentAccess)
+{
+
+}
+
+void UniformAllocator::addBarrier(BarrierBatch& batch, const std::vector<AccessSpecifier>& previousAccesses, AccessSpecifier currentAccess, bool discardContent)
+{
+	// only the host writes uniform data, and submissions make host writes visible, so passes need no barriers between their reads
+}
+
+VkDescriptorType UniformAllocator::getDescriptorType(AccessSpecifier::OPERATION operation) const
+{
+	return VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+}
+
+bool UniformAllocator::getDynamicOffset(uint32_t block, uint32_t frameSlot, uint32_t& offset) const
+{
+	offset = static_cast<uint32_t>(getBlockOffset(block, frameSlot));
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,90 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+#include "VulkanCore.h"
+#include "Resource.h"
+
+/**
+* @brief Persistently mapped uniform memory shared by many small uniform blocks, replacing a Buffer per block.
+*
+* Blocks are allocated linearly, each at a fixed offset within a region per frame slot. Passes bind the allocator as a dynamic uniform buffer, selecting their block and the region of the frame slot with a dynamic offset. Writing a block only waits for the frame that last used the same frame slot.
+*/
+class UniformAllocator : public Resource
+{
+public:
+
+	/**
+	* @brief Creates a UniformAllocator.
+	*
+	* @param blockSize size in bytes of every block, i.e. of the uniform struct shaders read
+	* @param maxBlocks number of blocks that can be allocated
+	*/
+	UniformAllocator(VulkanCore& vulkanCoreSupport, VkDeviceSize blockSize, uint32_t maxBlocks);
+
+	UniformAllocator(const UniformAllocator&) = delete;
+	UniformAllocator(UniformAllocator&&) = delete;
+	UniformAllocator& operator=(const UniformAllocator&) = delete;
+	UniformAllocator& operator=(UniformAllocator&&) = delete;
+
+	/**
+	* @brief Destroys this UniformAllocator, freeing allocated memory.
+	*/
+	~UniformAllocator();
+
+	/**
+	* @brief Allocates a block. Passes reading it refer to it in ResourceShaderInterface::uniformBlock.
+	*
+	* @return index of the block
+	*/
+	uint32_t allocate();
+
+	/**
+	* @brief Returns the content of a block used by the frame the host is currently preparing, so it can be written in place. Waits until the frame last using the same frame slot has completed.
+	*
+	* @param block index of the block
+	* @return mapped content of the block, or nullptr if the allocator was never created because only culled passes use it
+	*/
+	template<typename T>
+	T* mapped(uint32_t block)
+	{
+		return static_cast<T*>(getMappedData(block));
+	}
+
+	/**
+	* @brief Makes writes through mapped() visible to the device. Only does work if the memory is not host coherent.
+	*
+	* @param block index of the written block
+	*/
+	void flush(uint32_t block);
+
+	void createLayoutBinding(int index, AccessSpecifier access, VkDescriptorSetLayoutBinding& out) const override;
+	void createDescriptorWrite(int index, AccessSpecifier access, const VkDescriptorSet& descriptorSet, uint32_t frameSlot, VkWriteDescriptorSet& out) const override;
+
+	void prepareForInitialAccess(VkCommandBuffer& commandBuffer, AccessSpecifier currentAccess) override;
+
+	void addBarrier(BarrierBatch& batch, const std::vector<AccessSpecifier>& previousAccesses, AccessSpecifier currentAccess, bool discardContent = false) override;
+
+	VkDescriptorType getDescriptorType(AccessSpecifier::OPERATION operation) const override;
+
+	bool getDynamicOffset(uint32_t block, uint32_t frameSlot, uint32_t& offset) const override;
+
+private:
+
+	const VkDeviceSize blockSize;
+	const uint32_t maxBlocks;
+
+	uint32_t numBlocks = 0;
+
+	// distance between blocks, satisfying the device's alignment of dynamic offsets
+	VkDeviceSize blockStride = 0;
+
+	VkBuffer buffer = VK_NULL_HANDLE;
+	VmaAllocation allocation = VK_NULL_HANDLE;
+
+	// mapped for the lifetime of buffer
+	uint8_t* mappedData = nullptr;
+
+	VkDeviceSize getBlockOffset(uint32_t block, uint32_t frameSlot) const;
+
+	void* getMappedData(uint32_t block);
+};
\ No newline at end of file
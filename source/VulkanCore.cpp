@@ -1,5 +1,6 @@
 #define VMA_IMPLEMENTATION
 #include "VulkanCore.h"
+#include "BarrierBatch.h"
 #include <iostream>
 #include <vector>
 #include <array>
@@ -7,6 +8,9 @@
 #include <set>
 #include <algorithm>
 #include <cstring>
+#include <fstream>
+#include <numeric>
+#include <filesystem>
 #include "InputSupport.h"
 
 std::unordered_map<AccessSpecifier::OPERATION, VkDescriptorType> VulkanCore::descriptorTypes
@@ -16,6 +20,7 @@ std::unordered_map<AccessSpecifier::OPERATION, VkDescriptorType> VulkanCore::des
 	{AccessSpecifier::OPERATION::UNIFORM_BUFFER, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER},
 	{AccessSpecifier::OPERATION::SHADER_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER},
 	{AccessSpecifier::OPERATION::SHADER_STORAGE_IMAGE, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE},
+	{AccessSpecifier::OPERATION::INPUT_ATTACHMENT, VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT},
 };
 
 VkDevice& VulkanCore::getDevice()
@@ -33,6 +38,11 @@ VkSurfaceKHR VulkanCore::getSurface()
 	return surface;
 }
 
+bool VulkanCore::isHeadless() const
+{
+	return headless;
+}
+
 uint32_t VulkanCore::getGraphicsQueueFamilyIndex()
 {
 	return graphicsQueueFamilyIndex;
@@ -52,13 +62,92 @@ VkQueue VulkanCore::getPresentQueue()
 	return presentQueue;
 }
 
+bool VulkanCore::hasAsyncCompute() const
+{
+	return computeQueueFamilyIndex.has_value();
+}
+
+bool VulkanCore::hasTransferQueue() const
+{
+	return transferQueueFamilyIndex.has_value();
+}
+
+bool VulkanCore::hasHostVisibleDeviceMemory() const
+{
+	return hostVisibleDeviceMemory;
+}
+
+VulkanCore::QUEUE VulkanCore::resolveQueue(QUEUE queue) const
+{
+	switch (queue)
+	{
+	case QUEUE::ASYNC_COMPUTE:
+		return hasAsyncCompute() ? queue : QUEUE::GRAPHICS;
+	case QUEUE::TRANSFER:
+		return hasTransferQueue() ? queue : QUEUE::GRAPHICS;
+	default:
+		return QUEUE::GRAPHICS;
+	}
+}
+
+VkQueue VulkanCore::getQueue(QUEUE queue)
+{
+	switch (resolveQueue(queue))
+	{
+	case QUEUE::ASYNC_COMPUTE:
+		return computeQueue;
+	case QUEUE::TRANSFER:
+		return transferQueue;
+	default:
+		return graphicsQueue;
+	}
+}
+
+uint32_t VulkanCore::getQueueFamilyIndex(QUEUE queue)
+{
+	switch (resolveQueue(queue))
+	{
+	case QUEUE::ASYNC_COMPUTE:
+		return computeQueueFamilyIndex.value();
+	case QUEUE::TRANSFER:
+		return transferQueueFamilyIndex.value();
+	default:
+		return graphicsQueueFamilyIndex;
+	}
+}
+
+std::vector<uint32_t> VulkanCore::getResourceQueueFamilyIndices()
+{
+	std::vector<uint32_t> queueFamilyIndices{ graphicsQueueFamilyIndex };
+	if (hasAsyncCompute())
+	{
+		queueFamilyIndices.push_back(computeQueueFamilyIndex.value());
+	}
+	if (hasTransferQueue())
+	{
+		queueFamilyIndices.push_back(transferQueueFamilyIndex.value());
+	}
+
+	return queueFamilyIndices;
+}
+
 bool VulkanCore::engineRunning()
 {
+	if (headless)
+	{
+		return true;
+	}
+
 	return !glfwWindowShouldClose(VulkanCore::window);
 }
 
 VkExtent2D VulkanCore::getWindowResolution()
 {
+	if (headless)
+	{
+		return presentResolution;
+	}
+
 	int width, height;
 	glfwGetFramebufferSize(window, &width, &height);
 	return VkExtent2D{ static_cast<uint32_t>(width), static_cast<uint32_t>(height) };
@@ -70,7 +159,36 @@ void VulkanCore::createCommandPool()
 	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
 	poolInfo.queueFamilyIndex = VulkanCore::getGraphicsQueueFamilyIndex();
 
-	if (vkCreateCommandPool(VulkanCore::getDevice(), &poolInfo, nullptr, &commandPool) != VK_SUCCESS)
+	if (vkCreateCommandPool(VulkanCore::getDevice(), &poolInfo, nullptr, &instantCommandPool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create command pool");
+	}
+
+	// pass command buffers may be re-recorded individually
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+	uint32_t poolsPerQueue = threadPool.getNumThreads() * framesInFlight;
+	commandPools.resize(QUEUE_COUNT * poolsPerQueue, VK_NULL_HANDLE);
+	for (uint32_t poolIndex = 0; poolIndex < commandPools.size(); poolIndex++)
+	{
+		QUEUE queue = static_cast<QUEUE>(poolIndex / poolsPerQueue);
+		if (resolveQueue(queue) != queue)
+		{
+			continue;
+		}
+
+		poolInfo.queueFamilyIndex = getQueueFamilyIndex(queue);
+
+		if (vkCreateCommandPool(VulkanCore::getDevice(), &poolInfo, nullptr, &commandPools.at(poolIndex)) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create command pool");
+		}
+	}
+
+	// upload command buffers are freed individually once their upload completes
+	poolInfo.queueFamilyIndex = getQueueFamilyIndex(QUEUE::TRANSFER);
+
+	if (vkCreateCommandPool(VulkanCore::getDevice(), &poolInfo, nullptr, &uploadCommandPool) != VK_SUCCESS)
 	{
 		throw std::runtime_error("failed to create command pool");
 	}
@@ -81,7 +199,7 @@ void VulkanCore::setupInstantCommands()
 	// allocate command buffer
 	VkCommandBufferAllocateInfo allocInfo{};
 	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocInfo.commandPool = commandPool;
+	allocInfo.commandPool = instantCommandPool;
 	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
 	allocInfo.commandBufferCount = 1;
 
@@ -89,43 +207,111 @@ void VulkanCore::setupInstantCommands()
 	{
 		throw std::runtime_error("failed to allocate command buffers");
 	}
+}
+
+void VulkanCore::createTimelineSemaphores()
+{
+	VkSemaphoreTypeCreateInfo typeInfo{};
+	typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	typeInfo.initialValue = submissionValue;
+
+	VkSemaphoreCreateInfo semaphoreInfo{};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphoreInfo.pNext = &typeInfo;
+
+	// queues complete their submissions independently, so each has its own timeline
+	timelineSemaphores.resize(QUEUE_COUNT, VK_NULL_HANDLE);
+	pendingSubmissions.resize(QUEUE_COUNT);
+	for (uint32_t queue = 0; queue < QUEUE_COUNT; queue++)
+	{
+		if (resolveQueue(static_cast<QUEUE>(queue)) != queue)
+		{
+			continue;
+		}
+
+		if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &timelineSemaphores.at(queue)) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create timeline semaphore");
+		}
+	}
+}
 
-	// create fence
-	VkFenceCreateInfo fenceCreateInfo{};
-	fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+VulkanCore::VulkanCore(const VkExtent2D & renderResolution, const VkExtent2D & presentResolution, const std::string & windowName, const std::vector<const char*>& validationLayers, const std::vector<const char*>& deviceExtensions, uint32_t framesInFlight, const std::string& pipelineCachePath) : VulkanCore(renderResolution, presentResolution, windowName, validationLayers, deviceExtensions, framesInFlight, pipelineCachePath, false)
+{
+}
 
-	vkCreateFence(VulkanCore::getDevice(), &fenceCreateInfo, VK_NULL_HANDLE, &instantBufferReady);
+VulkanCore::VulkanCore(const VkExtent2D & renderResolution, const std::vector<const char*>& validationLayers, const std::vector<const char*>& deviceExtensions, uint32_t framesInFlight, const std::string& pipelineCachePath) : VulkanCore(renderResolution, renderResolution, "", validationLayers, deviceExtensions, framesInFlight, pipelineCachePath, true)
+{
 }
 
-VulkanCore::VulkanCore(const VkExtent2D & renderResolution, const VkExtent2D & presentResolution, const std::string & windowName, const std::vector<const char*>& validationLayers, const std::vector<const char*>& deviceExtensions) : renderResolution(renderResolution), presentResolution(presentResolution), windowName(windowName), validationLayersEnabled(validationLayers.size() > 0), validationLayers(validationLayers), deviceExtensions(deviceExtensions)
+VulkanCore::VulkanCore(const VkExtent2D & renderResolution, const VkExtent2D & presentResolution, const std::string & windowName, const std::vector<const char*>& validationLayers, const std::vector<const char*>& deviceExtensions, uint32_t framesInFlight, const std::string& pipelineCachePath, bool headless) : renderResolution(renderResolution), presentResolution(presentResolution), windowName(windowName), headless(headless), framesInFlight(framesInFlight), pipelineCachePath(pipelineCachePath), validationLayersEnabled(validationLayers.size() > 0), validationLayers(validationLayers), deviceExtensions(deviceExtensions)
 {
-	initWindow();
+	if (framesInFlight == 0)
+	{
+		throw std::runtime_error("at least one frame must be in flight");
+	}
+
+	if (!headless)
+	{
+		initWindow();
+	}
 
 	createInstance();
 	setupDebugMessenger();
 
-	createSurface();
+	if (!headless)
+	{
+		createSurface();
+	}
 	pickPhysicalDevice();
 
 	createLogicalDevice();
+	createPipelineCache();
 
 	initVmaAllocator();
+	createStagingBuffer();
 
 	createCommandPool();
 	setupInstantCommands();
+	createTimelineSemaphores();
 }
 
 VulkanCore::~VulkanCore()
 {
-	vkFreeCommandBuffers(VulkanCore::getDevice(), commandPool, 1, &instantBuffer);
-	vkDestroyCommandPool(VulkanCore::getDevice(), commandPool, nullptr);
+	// uploads still being recorded hold staging memory that's released once they complete
+	flushUploads();
+
+	vkDeviceWaitIdle(device);
+	reclaimUploads();
+	vkDestroyCommandPool(VulkanCore::getDevice(), uploadCommandPool, nullptr);
+
+	for (VkSemaphore timelineSemaphore : timelineSemaphores)
+	{
+		vkDestroySemaphore(device, timelineSemaphore, nullptr);
+	}
+
+	savePipelineCache();
+	vkDestroyPipelineCache(device, pipelineCache, nullptr);
+
+	vkFreeCommandBuffers(VulkanCore::getDevice(), instantCommandPool, 1, &instantBuffer);
+	vkDestroyCommandPool(VulkanCore::getDevice(), instantCommandPool, nullptr);
+	for (VkCommandPool pool : commandPools)
+	{
+		vkDestroyCommandPool(VulkanCore::getDevice(), pool, nullptr);
+	}
 
 	vkDestroyDescriptorPool(device, descriptorPool, nullptr);
 
+	bufferArenas.clear();
+	vmaDestroyBuffer(vmaAllocator, stagingBuffer, stagingAllocation);
 	vmaDestroyAllocator(vmaAllocator);
 
-	glfwDestroyWindow(window);
-	glfwTerminate();
+	if (!headless)
+	{
+		glfwDestroyWindow(window);
+		glfwTerminate();
+	}
 }
 
 uint32_t VulkanCore::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties)
@@ -174,7 +360,13 @@ void findQueueFamilies(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, ui
 			graphicsQueueFamilyIndex = i;
 		}
 
-		// check presentation queue support
+		// check presentation queue support. Without a surface nothing is presented, so the graphics queue stands in for the present queue
+		if (surface == VK_NULL_HANDLE)
+		{
+			presentQueueFamilyIndex = graphicsQueueFamilyIndex;
+			continue;
+		}
+
 		VkBool32 presentSupport = false;
 		vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, surface, &presentSupport);
 		if (presentSupport)
@@ -184,6 +376,64 @@ void findQueueFamilies(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, ui
 	}
 }
 
+std::optional<uint32_t> findComputeQueueFamily(VkPhysicalDevice physicalDevice)
+{
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+	// a family without graphics support is typically backed by separate hardware queues, so its work runs alongside graphics work
+	for (uint32_t i = 0; i < queueFamilyCount; i++)
+	{
+		VkQueueFlags flags = queueFamilies.at(i).queueFlags;
+		if ((flags & VK_QUEUE_COMPUTE_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT))
+		{
+			return i;
+		}
+	}
+
+	return std::nullopt;
+}
+
+std::optional<uint32_t> findTransferQueueFamily(VkPhysicalDevice physicalDevice)
+{
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+	// a family supporting nothing but transfers is backed by the copy engines, which work alongside the other queues
+	for (uint32_t i = 0; i < queueFamilyCount; i++)
+	{
+		VkQueueFlags flags = queueFamilies.at(i).queueFlags;
+		if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)))
+		{
+			return i;
+		}
+	}
+
+	return std::nullopt;
+}
+
+bool supportsDeviceExtension(VkPhysicalDevice device, const char* extensionName)
+{
+	uint32_t extensionCount;
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+	std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+
+	for (const auto& extension : availableExtensions)
+	{
+		if (strcmp(extension.extensionName, extensionName) == 0)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
 bool VulkanCore::checkDeviceExtensionSupport(VkPhysicalDevice device)
 {
 	uint32_t extensionCount;
@@ -230,10 +480,33 @@ void VulkanCore::DestroyDebugUtilsMessengerEXT(VkInstance instance
 
 
 
+// timeline semaphores track GPU progress, so they're required
+bool supportsTimelineSemaphores(VkPhysicalDevice device)
+{
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(device, &properties);
+	if (properties.apiVersion < VK_API_VERSION_1_2)
+	{
+		return false;
+	}
+
+	VkPhysicalDeviceVulkan12Features vulkan12Features{};
+	vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+	VkPhysicalDeviceFeatures2 features{};
+	features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	features.pNext = &vulkan12Features;
+	vkGetPhysicalDeviceFeatures2(device, &features);
+
+	return vulkan12Features.timelineSemaphore == VK_TRUE;
+}
+
 bool VulkanCore::isDeviceSuitable(VkPhysicalDevice device)
 {
-	bool extensionsSupported = checkDeviceExtensionSupport(device);
+	bool extensionsSupported = checkDeviceExtensionSupport(device) && supportsTimelineSemaphores(device);
 	findQueueFamilies(device, surface, graphicsQueueFamilyIndex, presentQueueFamilyIndex);
+	computeQueueFamilyIndex = findComputeQueueFamily(device);
+	transferQueueFamilyIndex = findTransferQueueFamily(device);
 	return foundQueueFamilies({graphicsQueueFamilyIndex, presentQueueFamilyIndex}) && extensionsSupported;
 }
 
@@ -296,11 +569,17 @@ bool VulkanCore::checkValidationLayerSupport()
 
 std::vector<const char*> VulkanCore::getRequiredExtensions()
 {
-	uint32_t glfwExtensionCount = 0;
-	const char** glfwExtensions;
-	glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+	std::vector<const char*> extensions;
+
+	// surface extensions are only needed to present to a window
+	if (!headless)
+	{
+		uint32_t glfwExtensionCount = 0;
+		const char** glfwExtensions;
+		glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
 
-	std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+		extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+	}
 
 	if (validationLayersEnabled)
 	{
@@ -334,7 +613,13 @@ void VulkanCore::createInstance()
 
 	VkInstanceCreateInfo createInfo{};
 	createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
-	createInfo.pApplicationInfo = VK_NULL_HANDLE;
+
+	VkApplicationInfo applicationInfo{};
+	applicationInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+	applicationInfo.pApplicationName = windowName.c_str();
+	applicationInfo.pEngineName = "cgin";
+	applicationInfo.apiVersion = VK_API_VERSION_1_2;
+	createInfo.pApplicationInfo = &applicationInfo;
 
 
 	uint32_t extensionCount = 0;
@@ -384,6 +669,14 @@ void VulkanCore::createLogicalDevice()
 		graphicsQueueFamilyIndex,
 		presentQueueFamilyIndex
 	};
+	if (hasAsyncCompute())
+	{
+		uniqueQueueFamilies.insert(computeQueueFamilyIndex.value());
+	}
+	if (hasTransferQueue())
+	{
+		uniqueQueueFamilies.insert(transferQueueFamilyIndex.value());
+	}
 
 	float queuePriority = 1.0f;
 	for (uint32_t queueFamily : uniqueQueueFamilies)
@@ -408,8 +701,22 @@ void VulkanCore::createLogicalDevice()
 
 	createInfo.pEnabledFeatures = &requestedFeatures;
 
-	createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-	createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+	VkPhysicalDeviceVulkan12Features requestedVulkan12Features{};
+	requestedVulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	requestedVulkan12Features.timelineSemaphore = VK_TRUE;
+
+	createInfo.pNext = &requestedVulkan12Features;
+
+	// creation feedback is optional. It's only used to report pipeline cache hits
+	std::vector<const char*> enabledExtensions = deviceExtensions;
+	if (supportsDeviceExtension(physicalDevice, VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME))
+	{
+		enabledExtensions.push_back(VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME);
+		pipelineCreationFeedbackEnabled = true;
+	}
+
+	createInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
+	createInfo.ppEnabledExtensionNames = enabledExtensions.data();
 
 	if (validationLayersEnabled)
 	{
@@ -428,6 +735,14 @@ void VulkanCore::createLogicalDevice()
 
 	vkGetDeviceQueue(device, graphicsQueueFamilyIndex, 0, &graphicsQueue);
 	vkGetDeviceQueue(device, presentQueueFamilyIndex, 0, &presentQueue);
+	if (hasAsyncCompute())
+	{
+		vkGetDeviceQueue(device, computeQueueFamilyIndex.value(), 0, &computeQueue);
+	}
+	if (hasTransferQueue())
+	{
+		vkGetDeviceQueue(device, transferQueueFamilyIndex.value(), 0, &transferQueue);
+	}
 }
 
 void VulkanCore::initVmaAllocator()
@@ -436,8 +751,32 @@ void VulkanCore::initVmaAllocator()
 	createInfo.physicalDevice = physicalDevice;
 	createInfo.device = device;
 	createInfo.instance = vInstance;
+	createInfo.vulkanApiVersion = VK_API_VERSION_1_2;
 
 	vmaCreateAllocator(&createInfo, &vmaAllocator);
+
+	const VkPhysicalDeviceMemoryProperties* memoryProperties;
+	vmaGetMemoryProperties(vmaAllocator, &memoryProperties);
+
+	VkDeviceSize largestDeviceHeap = 0;
+	for (uint32_t i = 0; i < memoryProperties->memoryHeapCount; i++)
+	{
+		if (memoryProperties->memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+		{
+			largestDeviceHeap = std::max(largestDeviceHeap, memoryProperties->memoryHeaps[i].size);
+		}
+	}
+
+	// without resizable BAR only a small window of device memory is host visible, which the driver uses as well, so it's not worth competing for
+	const VkMemoryPropertyFlags hostVisibleDevice = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+	for (uint32_t i = 0; i < memoryProperties->memoryTypeCount; i++)
+	{
+		const VkMemoryType& memoryType = memoryProperties->memoryTypes[i];
+		if ((memoryType.propertyFlags & hostVisibleDevice) == hostVisibleDevice && memoryProperties->memoryHeaps[memoryType.heapIndex].size == largestDeviceHeap)
+		{
+			hostVisibleDeviceMemory = true;
+		}
+	}
 }
 
 void VulkanCore::setupDebugMessenger()
@@ -493,7 +832,7 @@ void VulkanCore::createDescriptorPool(std::vector<VkDescriptorType> descriptorsU
 	{
 		VkDescriptorPoolSize size{};
 		size.type = pair.first;
-		size.descriptorCount = pair.second;
+		size.descriptorCount = pair.second * framesInFlight;
 
 		poolSizes.push_back(size);
 	}
@@ -502,7 +841,7 @@ void VulkanCore::createDescriptorPool(std::vector<VkDescriptorType> descriptorsU
 	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
 	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
 	poolInfo.pPoolSizes = poolSizes.data();
-	poolInfo.maxSets = static_cast<uint32_t>(numPasses);
+	poolInfo.maxSets = static_cast<uint32_t>(numPasses) * framesInFlight;
 
 	if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS)
 	{
@@ -528,7 +867,7 @@ VmaAllocator VulkanCore::getVmaAllocator()
 void VulkanCore::executeInstantCommands(std::function<void(VkCommandBuffer)> commands)
 {
 	VkCommandPoolResetFlags flags{};
-	vkResetCommandPool(VulkanCore::getDevice(), commandPool, VK_COMMAND_BUFFER_RESET_RELEASE_RESOURCES_BIT);
+	vkResetCommandPool(VulkanCore::getDevice(), instantCommandPool, VK_COMMAND_BUFFER_RESET_RELEASE_RESOURCES_BIT);
 
 	VkCommandBufferBeginInfo beginInfo{};
 	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -540,11 +879,244 @@ void VulkanCore::executeInstantCommands(std::function<void(VkCommandBuffer)> com
 
 	vkEndCommandBuffer(instantBuffer);
 
-	submitCommandBuffer(instantBuffer, instantBufferReady);
+	SubmitBatch batch{};
+	batch.commandBuffers.push_back(instantBuffer);
+
+	// the commands may access resources last accessed on another queue
+	batch.crossQueueWaitStages = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
 
 	// wait until commands are complete
-	vkWaitForFences(VulkanCore::getDevice(), 1, &instantBufferReady, VK_TRUE, UINT64_MAX);
-	vkResetFences(VulkanCore::getDevice(), 1, &instantBufferReady);
+	waitForSubmission(submitCommandBuffers({ batch }));
+}
+
+uint64_t VulkanCore::executeUploadCommands(std::function<void(VkCommandBuffer)> commands, std::function<void()> onComplete, uint64_t waitSubmission)
+{
+	if (openUploadCommandBuffer == VK_NULL_HANDLE)
+	{
+		reclaimUploads();
+
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = uploadCommandPool;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandBufferCount = 1;
+
+		if (vkAllocateCommandBuffers(VulkanCore::getDevice(), &allocInfo, &openUploadCommandBuffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to allocate command buffers");
+		}
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+		vkBeginCommandBuffer(openUploadCommandBuffer, &beginInfo);
+
+		// without a transfer-only queue uploads share a queue with passes, so they're ordered against earlier work on it and make their writes visible to later work. On a transfer-only queue this only orders uploads against each other
+		BarrierBatch beforeUpload;
+		beforeUpload.addMemoryBarrier(VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_MEMORY_WRITE_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+		beforeUpload.record(openUploadCommandBuffer);
+	}
+	else
+	{
+		// uploads batched into one command buffer may write the same memory, e.g. updates of a Buffer in consecutive frames
+		BarrierBatch betweenUploads;
+		betweenUploads.addMemoryBarrier(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+		betweenUploads.record(openUploadCommandBuffer);
+	}
+
+	commands(openUploadCommandBuffer);
+
+	// a resource last used by the open upload itself is ordered against it by the barriers above
+	if (waitSubmission <= submissionValue)
+	{
+		openUploadWaitSubmission = std::max(openUploadWaitSubmission, waitSubmission);
+	}
+
+	if (onComplete)
+	{
+		openUploadCallbacks.push_back(onComplete);
+	}
+
+	// every submission flushes the recorded uploads first, so they're always submitted with the next submission value
+	return submissionValue + 1;
+}
+
+void VulkanCore::flushUploads()
+{
+	if (openUploadCommandBuffer == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	// cleared first, since submitting flushes uploads as well
+	VkCommandBuffer commandBuffer = openUploadCommandBuffer;
+	openUploadCommandBuffer = VK_NULL_HANDLE;
+
+	// waits for all commands rather than the copies, so that layout transitions recorded with the uploads are made visible as well
+	BarrierBatch afterUpload;
+	afterUpload.addMemoryBarrier(VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT);
+	afterUpload.record(commandBuffer);
+
+	vkEndCommandBuffer(commandBuffer);
+
+	SubmitBatch batch{};
+	batch.commandBuffers.push_back(commandBuffer);
+
+	// only the submissions still using the overwritten resources are waited for, so uploads don't wait for frames that don't touch them
+	batch.submissionWaitValue = openUploadWaitSubmission;
+	batch.submissionWaitStages = VK_PIPELINE_STAGE_TRANSFER_BIT;
+	openUploadWaitSubmission = 0;
+
+	latestUploadSubmission = submitCommandBuffers({ batch }, QUEUE::TRANSFER);
+	pendingUploads.push_back(PendingUpload{ commandBuffer, latestUploadSubmission, std::move(openUploadCallbacks) });
+	openUploadCallbacks.clear();
+
+	// data staged since the previous submission is copied by this one
+	for (auto range = stagingRanges.rbegin(); range != stagingRanges.rend() && range->submissionValue == 0; range++)
+	{
+		range->submissionValue = latestUploadSubmission;
+	}
+}
+
+BufferArena& VulkanCore::getBufferArena(VkBufferUsageFlags usage, const VmaAllocationCreateInfo& allocationInfo)
+{
+	auto key = std::make_tuple(usage, allocationInfo.flags, allocationInfo.usage, allocationInfo.preferredFlags);
+	auto arena = bufferArenas.find(key);
+	if (arena != bufferArenas.end())
+	{
+		return *arena->second;
+	}
+
+	// descriptors may point at any slice, so slices are aligned for every descriptor type their usage allows
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+	VkDeviceSize alignment = 16;
+	if (usage & VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT)
+	{
+		alignment = std::max(alignment, properties.limits.minUniformBufferOffsetAlignment);
+	}
+	if (usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT)
+	{
+		alignment = std::max(alignment, properties.limits.minStorageBufferOffsetAlignment);
+	}
+
+	auto& created = bufferArenas[key];
+	created = std::make_unique<BufferArena>(vmaAllocator, usage, getResourceQueueFamilyIndices(), allocationInfo, alignment);
+	return *created;
+}
+
+void VulkanCore::createStagingBuffer()
+{
+	VkBufferCreateInfo bufferInfo{};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = STAGING_BUFFER_SIZE;
+	bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	VmaAllocationCreateInfo allocationInfo{};
+	allocationInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+	allocationInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_HOST;
+
+	VmaAllocationInfo allocationResult{};
+	if (vmaCreateBuffer(vmaAllocator, &bufferInfo, &allocationInfo, &stagingBuffer, &stagingAllocation, &allocationResult) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create staging buffer");
+	}
+
+	stagingData = static_cast<uint8_t*>(allocationResult.pMappedData);
+}
+
+bool VulkanCore::findStagingRoom(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset) const
+{
+	if (stagingRanges.empty())
+	{
+		offset = 0;
+		return true;
+	}
+
+	VkDeviceSize tail = stagingRanges.front().offset;
+	VkDeviceSize head = (stagingRanges.back().offset + stagingRanges.back().size + alignment - 1) / alignment * alignment;
+
+	// ranges in use either lie between tail and head, or wrap around and lie after tail and before head
+	if (head > tail)
+	{
+		if (head + size <= STAGING_BUFFER_SIZE)
+		{
+			offset = head;
+			return true;
+		}
+
+		offset = 0;
+		return size <= tail;
+	}
+
+	offset = head;
+	return head + size <= tail;
+}
+
+bool VulkanCore::stageUploadData(VkDeviceSize size, const void* data, StagingRegion& region, VkDeviceSize alignment)
+{
+	return stageUploadData(size, [size, data](void* destination) { memcpy(destination, data, static_cast<size_t>(size)); }, region, alignment);
+}
+
+bool VulkanCore::stageUploadData(VkDeviceSize size, const std::function<void(void*)>& write, StagingRegion& region, VkDeviceSize alignment)
+{
+	// e.g. 12 byte texels need offsets that are multiples of 48
+	alignment = std::lcm(alignment, STAGING_ALIGNMENT);
+
+	if (size > STAGING_BUFFER_SIZE)
+	{
+		return false;
+	}
+
+	reclaimUploads();
+
+	// the oldest range is reused first, so waiting for it frees room soonest
+	VkDeviceSize offset = 0;
+	while (!findStagingRoom(size, alignment, offset))
+	{
+		// the ring is full of data of uploads still being recorded
+		if (stagingRanges.front().submissionValue == 0)
+		{
+			flushUploads();
+		}
+
+		waitForSubmission(stagingRanges.front().submissionValue);
+		reclaimUploads();
+	}
+
+	write(stagingData + offset);
+	vmaFlushAllocation(vmaAllocator, stagingAllocation, offset, size);
+
+	stagingRanges.push_back(StagingRange{ offset, size, 0 });
+
+	region.buffer = stagingBuffer;
+	region.offset = offset;
+	return true;
+}
+
+void VulkanCore::reclaimUploads()
+{
+	uint64_t completedValue = getCompletedSubmission();
+
+	while (!stagingRanges.empty() && stagingRanges.front().submissionValue != 0 && stagingRanges.front().submissionValue <= completedValue)
+	{
+		stagingRanges.pop_front();
+	}
+
+	while (!pendingUploads.empty() && pendingUploads.front().submissionValue <= completedValue)
+	{
+		PendingUpload& upload = pendingUploads.front();
+		vkFreeCommandBuffers(VulkanCore::getDevice(), uploadCommandPool, 1, &upload.commandBuffer);
+		for (const std::function<void()>& onComplete : upload.onComplete)
+		{
+			onComplete();
+		}
+
+		pendingUploads.pop_front();
+	}
 }
 
 const VkExtent2D& VulkanCore::getRenderResolution() const
@@ -552,22 +1124,400 @@ const VkExtent2D& VulkanCore::getRenderResolution() const
 	return renderResolution;
 }
 
-void VulkanCore::submitCommandBuffer(VkCommandBuffer& commandBuffer, VkFence signalFence)
+VkPipelineCache VulkanCore::getPipelineCache()
+{
+	return pipelineCache;
+}
+
+bool VulkanCore::isPipelineCacheCompatible(const std::vector<char>& data)
+{
+	VkPipelineCacheHeaderVersionOne header;
+	if (data.size() < sizeof(header))
+	{
+		return false;
+	}
+	memcpy(&header, data.data(), sizeof(header));
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+	return header.headerSize >= sizeof(header)
+		&& header.headerSize <= data.size()
+		&& header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+		&& header.vendorID == properties.vendorID
+		&& header.deviceID == properties.deviceID
+		&& memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+void VulkanCore::createPipelineCache()
+{
+	std::vector<char> initialData;
+
+	if (!pipelineCachePath.empty())
+	{
+		std::ifstream file(pipelineCachePath, std::ios::ate | std::ios::binary);
+		if (file.is_open())
+		{
+			initialData.resize(static_cast<size_t>(file.tellg()));
+			file.seekg(0);
+			file.read(initialData.data(), initialData.size());
+		}
+
+		// a cache from another device or driver would be rejected or, worse, trusted by a buggy driver. Start empty instead
+		if (!initialData.empty() && !isPipelineCacheCompatible(initialData))
+		{
+			std::cerr << "discarding incompatible pipeline cache " << pipelineCachePath << std::endl;
+			initialData.clear();
+		}
+	}
+
+	VkPipelineCacheCreateInfo createInfo{};
+	createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	createInfo.initialDataSize = initialData.size();
+	createInfo.pInitialData = initialData.empty() ? nullptr : initialData.data();
+
+	if (vkCreatePipelineCache(device, &createInfo, nullptr, &pipelineCache) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create pipeline cache");
+	}
+}
+
+void VulkanCore::savePipelineCache()
+{
+	if (pipelineCachePath.empty())
+	{
+		return;
+	}
+
+	size_t dataSize = 0;
+	if (vkGetPipelineCacheData(device, pipelineCache, &dataSize, nullptr) != VK_SUCCESS)
+	{
+		std::cerr << "failed to get pipeline cache data" << std::endl;
+		return;
+	}
+
+	std::vector<char> data(dataSize);
+	if (vkGetPipelineCacheData(device, pipelineCache, &dataSize, data.data()) != VK_SUCCESS)
+	{
+		std::cerr << "failed to get pipeline cache data" << std::endl;
+		return;
+	}
+
+	std::string temporaryPath = pipelineCachePath + ".tmp";
+	std::error_code error;
+
+	// closing flushes the data, so the rename only ever publishes a complete file
+	std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+	file.write(data.data(), dataSize);
+	file.close();
+	if (file.fail())
+	{
+		std::cerr << "failed to write pipeline cache " << temporaryPath << std::endl;
+		std::filesystem::remove(temporaryPath, error);
+		return;
+	}
+
+	// rename replaces the previous cache in one step
+	std::filesystem::rename(temporaryPath, pipelineCachePath, error);
+	if (error)
+	{
+		std::cerr << "failed to save pipeline cache " << pipelineCachePath << ": " << error.message() << std::endl;
+		std::filesystem::remove(temporaryPath, error);
+	}
+}
+
+ThreadPool& VulkanCore::getThreadPool()
+{
+	return threadPool;
+}
+
+void VulkanCore::createGraphicsPipeline(const VkGraphicsPipelineCreateInfo& createInfo, VkPipeline& pipeline)
+{
+	VkPipelineCreationFeedbackEXT feedback{};
+
+	VkPipelineCreationFeedbackCreateInfoEXT feedbackInfo{};
+	feedbackInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO_EXT;
+	feedbackInfo.pNext = createInfo.pNext;
+	feedbackInfo.pPipelineCreationFeedback = &feedback;
+
+	VkGraphicsPipelineCreateInfo info = createInfo;
+	if (pipelineCreationFeedbackEnabled)
+	{
+		info.pNext = &feedbackInfo;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	if (vkCreateGraphicsPipelines(device, pipelineCache, 1, &info, nullptr, &pipeline) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create graphics pipeline");
+	}
+	recordPipelineCreation(feedback, std::chrono::steady_clock::now() - start);
+}
+
+void VulkanCore::createComputePipeline(const VkComputePipelineCreateInfo& createInfo, VkPipeline& pipeline)
+{
+	VkPipelineCreationFeedbackEXT feedback{};
+
+	VkPipelineCreationFeedbackCreateInfoEXT feedbackInfo{};
+	feedbackInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO_EXT;
+	feedbackInfo.pNext = createInfo.pNext;
+	feedbackInfo.pPipelineCreationFeedback = &feedback;
+
+	VkComputePipelineCreateInfo info = createInfo;
+	if (pipelineCreationFeedbackEnabled)
+	{
+		info.pNext = &feedbackInfo;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	if (vkCreateComputePipelines(device, pipelineCache, 1, &info, nullptr, &pipeline) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create compute pipeline");
+	}
+	recordPipelineCreation(feedback, std::chrono::steady_clock::now() - start);
+}
+
+void VulkanCore::recordPipelineCreation(const VkPipelineCreationFeedbackEXT& feedback, std::chrono::steady_clock::duration creationTime)
+{
+	double milliseconds = std::chrono::duration<double, std::milli>(creationTime).count();
+
+	std::lock_guard<std::mutex> lock(pipelineCacheStatisticsMutex);
+
+	// without feedback there's no telling whether the cache supplied the pipeline
+	if (!(feedback.flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT_EXT))
+	{
+		pipelineCacheStatistics.unknown++;
+		pipelineCacheStatistics.unknownMilliseconds += milliseconds;
+	}
+	else if (feedback.flags & VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT_EXT)
+	{
+		pipelineCacheStatistics.hits++;
+		pipelineCacheStatistics.hitMilliseconds += milliseconds;
+	}
+	else
+	{
+		pipelineCacheStatistics.misses++;
+		pipelineCacheStatistics.missMilliseconds += milliseconds;
+	}
+}
+
+const PipelineCacheStatistics& VulkanCore::getPipelineCacheStatistics() const
+{
+	return pipelineCacheStatistics;
+}
+
+uint32_t VulkanCore::getFramesInFlight() const
+{
+	return framesInFlight;
+}
+
+uint32_t VulkanCore::getFrameSlot() const
+{
+	return frameSlot;
+}
+
+void VulkanCore::advanceFrameSlot()
+{
+	frameSlot = (frameSlot + 1) % framesInFlight;
+}
+
+uint64_t VulkanCore::submitCommandBuffers(const std::vector<SubmitBatch>& batches, QUEUE queue)
+{
+	if (batches.empty())
+	{
+		throw std::runtime_error("no command buffers to submit");
+	}
+
+	// recorded uploads were promised the next submission value, and the batches may depend on them
+	flushUploads();
+
+	queue = resolveQueue(queue);
+
+	// drops completed submissions, so batches only wait for submissions that may still be executing
+	getCompletedSubmission();
+
+	// batches on other queues wait for uploads still executing, which hands the uploaded resources over to the passes
+	QUEUE uploadQueue = resolveQueue(QUEUE::TRANSFER);
+	const std::deque<uint64_t>& pendingUploadQueue = pendingSubmissions.at(uploadQueue);
+	bool uploadPending = queue != uploadQueue && !pendingUploadQueue.empty() && latestUploadSubmission >= pendingUploadQueue.front();
+
+	++submissionValue;
+
+	std::vector<VkSubmitInfo> submitInfos(batches.size());
+	std::vector<VkTimelineSemaphoreSubmitInfo> timelineInfos(batches.size());
+	std::vector<std::vector<VkSemaphore>> waitSemaphores(batches.size());
+	std::vector<std::vector<VkPipelineStageFlags>> waitStages(batches.size());
+	std::vector<std::vector<uint64_t>> waitValues(batches.size());
+
+	// the final batch also signals the timeline of the queue. Signal operations cover every command submitted before them, so this covers all batches
+	std::vector<VkSemaphore> finalSignalSemaphores;
+	std::vector<uint64_t> finalSignalValues;
+
+	for (size_t i = 0; i < batches.size(); i++)
+	{
+		const SubmitBatch& batch = batches.at(i);
+
+		waitSemaphores.at(i) = batch.waitSemaphores;
+		waitStages.at(i) = batch.waitStages;
+
+		// values of binary semaphores are ignored
+		waitValues.at(i).resize(batch.waitSemaphores.size(), 0);
+
+		// the most recent submission to a queue completes after all earlier ones, so waiting for it covers them
+		for (uint32_t otherQueue = 0; otherQueue < QUEUE_COUNT; otherQueue++)
+		{
+			if (otherQueue == queue || pendingSubmissions.at(otherQueue).empty())
+			{
+				continue;
+			}
+
+			const std::deque<uint64_t>& pending = pendingSubmissions.at(otherQueue);
+
+			if (batch.crossQueueWaitStages != 0)
+			{
+				waitSemaphores.at(i).push_back(timelineSemaphores.at(otherQueue));
+				waitStages.at(i).push_back(batch.crossQueueWaitStages);
+				waitValues.at(i).push_back(pending.back());
+			}
+
+			// the uploads are waited for at the stages the batch first accesses uploaded resources at
+			if (uploadPending && otherQueue == uploadQueue && batch.uploadWaitStages != 0)
+			{
+				waitSemaphores.at(i).push_back(timelineSemaphores.at(otherQueue));
+				waitStages.at(i).push_back(batch.uploadWaitStages);
+				waitValues.at(i).push_back(latestUploadSubmission);
+			}
+
+			// the latest submission to the queue up to the value covers the earlier ones. None is pending if all have completed
+			auto waited = std::upper_bound(pending.begin(), pending.end(), batch.submissionWaitValue);
+			if (batch.submissionWaitStages != 0 && waited != pending.begin())
+			{
+				waitSemaphores.at(i).push_back(timelineSemaphores.at(otherQueue));
+				waitStages.at(i).push_back(batch.submissionWaitStages);
+				waitValues.at(i).push_back(*std::prev(waited));
+			}
+		}
+
+		VkTimelineSemaphoreSubmitInfo& timelineInfo = timelineInfos.at(i);
+		timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+		timelineInfo.waitSemaphoreValueCount = static_cast<uint32_t>(waitValues.at(i).size());
+		timelineInfo.pWaitSemaphoreValues = waitValues.at(i).data();
+
+		VkSubmitInfo& submitInfo = submitInfos.at(i);
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.pNext = &timelineInfo;
+		submitInfo.commandBufferCount = static_cast<uint32_t>(batch.commandBuffers.size());
+		submitInfo.pCommandBuffers = batch.commandBuffers.data();
+
+		submitInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.at(i).size());
+		submitInfo.pWaitSemaphores = waitSemaphores.at(i).data();
+		submitInfo.pWaitDstStageMask = waitStages.at(i).data();
+		submitInfo.signalSemaphoreCount = static_cast<uint32_t>(batch.signalSemaphores.size());
+		submitInfo.pSignalSemaphores = batch.signalSemaphores.data();
+
+		if (i == batches.size() - 1)
+		{
+			finalSignalSemaphores = batch.signalSemaphores;
+			finalSignalSemaphores.push_back(timelineSemaphores.at(queue));
+
+			// values of binary semaphores are ignored
+			finalSignalValues.resize(finalSignalSemaphores.size(), 0);
+			finalSignalValues.back() = submissionValue;
+
+			timelineInfo.signalSemaphoreValueCount = static_cast<uint32_t>(finalSignalValues.size());
+			timelineInfo.pSignalSemaphoreValues = finalSignalValues.data();
+
+			submitInfo.signalSemaphoreCount = static_cast<uint32_t>(finalSignalSemaphores.size());
+			submitInfo.pSignalSemaphores = finalSignalSemaphores.data();
+		}
+	}
+
+	if (vkQueueSubmit(getQueue(queue), static_cast<uint32_t>(submitInfos.size()), submitInfos.data(), VK_NULL_HANDLE) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to submit command buffers");
+	}
+
+	pendingSubmissions.at(queue).push_back(submissionValue);
+
+	return submissionValue;
+}
+
+uint64_t VulkanCore::getCompletedSubmission()
 {
-	VkSubmitInfo submitInfo{};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffer;
+	if (completedSubmissionValue >= submissionValue)
+	{
+		return completedSubmissionValue;
+	}
 
-	submitInfo.waitSemaphoreCount = 0;
-	submitInfo.pWaitSemaphores = VK_NULL_HANDLE;
-	submitInfo.signalSemaphoreCount = 0;
-	submitInfo.pSignalSemaphores = VK_NULL_HANDLE;
+	// queues may complete out of submission order, so only the values below the oldest pending submission of every queue have completed
+	uint64_t completedValue = submissionValue;
+	for (uint32_t queue = 0; queue < QUEUE_COUNT; queue++)
+	{
+		std::deque<uint64_t>& pending = pendingSubmissions.at(queue);
+		if (pending.empty())
+		{
+			continue;
+		}
+
+		uint64_t timelineValue = 0;
+		vkGetSemaphoreCounterValue(device, timelineSemaphores.at(queue), &timelineValue);
+		while (!pending.empty() && pending.front() <= timelineValue)
+		{
+			pending.pop_front();
+		}
+
+		if (!pending.empty())
+		{
+			completedValue = std::min(completedValue, pending.front() - 1);
+		}
+	}
+
+	completedSubmissionValue = completedValue;
+	return completedSubmissionValue;
+}
+
+void VulkanCore::waitForSubmission(uint64_t value)
+{
+	// values beyond the latest submission belong to recorded uploads
+	if (value > submissionValue)
+	{
+		flushUploads();
+	}
+
+	if (getCompletedSubmission() >= value)
+	{
+		return;
+	}
+
+	// the most recent submission up to value on every queue still executing one
+	std::vector<VkSemaphore> semaphores;
+	std::vector<uint64_t> values;
+	for (uint32_t queue = 0; queue < QUEUE_COUNT; queue++)
+	{
+		const std::deque<uint64_t>& pending = pendingSubmissions.at(queue);
+		auto firstLater = std::upper_bound(pending.begin(), pending.end(), value);
+		if (firstLater != pending.begin())
+		{
+			semaphores.push_back(timelineSemaphores.at(queue));
+			values.push_back(*std::prev(firstLater));
+		}
+	}
+
+	VkSemaphoreWaitInfo waitInfo{};
+	waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+	waitInfo.semaphoreCount = static_cast<uint32_t>(semaphores.size());
+	waitInfo.pSemaphores = semaphores.data();
+	waitInfo.pValues = values.data();
+
+	if (vkWaitSemaphores(device, &waitInfo, UINT64_MAX) != VK_SUCCESS)
+	{
+		throw std::runtime_error("wait for submission timeout");
+	}
 
-	vkQueueSubmit(VulkanCore::getGraphicsQueue(), 1, &submitInfo, signalFence);
+	getCompletedSubmission();
 }
 
-VkCommandPool VulkanCore::getCommandPool()
+VkCommandPool VulkanCore::getCommandPool(uint32_t threadIndex, uint32_t frameSlot, QUEUE queue)
 {
-	return commandPool;
+	return commandPools.at((resolveQueue(queue) * threadPool.getNumThreads() + threadIndex) * framesInFlight + frameSlot);
 }
\ No newline at end of file
@@ -4,12 +4,98 @@
 #include <GLFW/glfw3.h>
 #include <vk_mem_alloc.h>
 #include <optional>
+#include <deque>
 #include <vector>
 #include <iostream>
 #include <unordered_map>
 #include <functional>
+#include <chrono>
+#include <mutex>
+#include <algorithm>
+#include <map>
+#include <tuple>
+#include <memory>
 
 #include "AccessSpecifier.h"
+#include "ThreadPool.h"
+#include "BufferArena.h"
+
+/**
+* @brief Command buffers submitted as one batch, along with the semaphores the batch waits on and signals.
+*/
+struct SubmitBatch
+{
+	/**
+	* @brief command buffers to execute, in order
+	*/
+	std::vector<VkCommandBuffer> commandBuffers;
+
+	/**
+	* @brief semaphores to wait on before executing
+	*/
+	std::vector<VkSemaphore> waitSemaphores;
+
+	/**
+	* @brief stages at which each element of waitSemaphores is waited on
+	*/
+	std::vector<VkPipelineStageFlags> waitStages;
+
+	/**
+	* @brief semaphores to signal once commandBuffers complete
+	*/
+	std::vector<VkSemaphore> signalSemaphores;
+
+	/**
+	* @brief stages at which the batch waits for the most recent submission to every other queue, e.g. because it accesses resources those submissions accessed. 0 to not wait for other queues
+	*/
+	VkPipelineStageFlags crossQueueWaitStages = 0;
+
+	/**
+	* @brief stages at which the batch waits for uploads that may not have completed, i.e. the stages its commands first access uploaded resources at. 0 if it uses none
+	*/
+	VkPipelineStageFlags uploadWaitStages = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+	/**
+	* @brief the batch waits for every submission to other queues up to this value. 0 to not wait
+	*/
+	uint64_t submissionWaitValue = 0;
+
+	/**
+	* @brief stages at which the batch waits for submissionWaitValue
+	*/
+	VkPipelineStageFlags submissionWaitStages = 0;
+};
+
+/**
+* @brief Location of data staged for an upload.
+*/
+struct StagingRegion
+{
+	/**
+	* @brief buffer holding the data
+	*/
+	VkBuffer buffer = VK_NULL_HANDLE;
+
+	/**
+	* @brief offset of the data in buffer, in bytes
+	*/
+	VkDeviceSize offset = 0;
+};
+
+/**
+* @brief Counts and total creation times of pipelines created through VulkanCore, split by whether the pipeline cache supplied them.
+*
+* Cache hits are reported by VK_EXT_pipeline_creation_feedback. Where the extension is unsupported, or the driver gives no valid feedback, creations count as unknown.
+*/
+struct PipelineCacheStatistics
+{
+	uint32_t hits = 0;
+	uint32_t misses = 0;
+	uint32_t unknown = 0;
+	double hitMilliseconds = 0.0;
+	double missMilliseconds = 0.0;
+	double unknownMilliseconds = 0.0;
+};
 
 /**
 * @brief Wrapper over low-level Vulkan API calls.
@@ -19,7 +105,42 @@ class VulkanCore
 
 public:
 
-	VulkanCore(const VkExtent2D & renderResolution, const VkExtent2D & presentResolution, const std::string & windowName, const std::vector<const char*>& validationLayers, const std::vector<const char*>& deviceExtensions);
+	/**
+	* @brief Queues work may be submitted to.
+	*/
+	enum QUEUE
+	{
+		/// Queue supporting all operations, including presentation
+		GRAPHICS,
+		/// Compute-only queue executing alongside GRAPHICS. Work submitted to it goes to GRAPHICS where the device has no compute-only queue family
+		ASYNC_COMPUTE,
+		/// Transfer-only queue uploads are submitted to. Uploads go to GRAPHICS where the device has no transfer-only queue family
+		TRANSFER,
+	};
+
+	/**
+	* @brief Creates a VulkanCore presenting to a window.
+	*
+	* @param renderResolution internal rendering resolution
+	* @param presentResolution window resolution
+	* @param windowName title of the window
+	* @param validationLayers validation layers to enable
+	* @param deviceExtensions device extensions to enable
+	* @param framesInFlight number of frames the host may record ahead of the GPU
+	* @param pipelineCachePath file the pipeline cache is loaded from and saved to. Empty to keep the cache in memory only
+	*/
+	VulkanCore(const VkExtent2D & renderResolution, const VkExtent2D & presentResolution, const std::string & windowName, const std::vector<const char*>& validationLayers, const std::vector<const char*>& deviceExtensions, uint32_t framesInFlight = 2, const std::string& pipelineCachePath = "pipeline_cache.bin");
+
+	/**
+	* @brief Creates a headless VulkanCore. No window, surface or swap chain is created, so output can only be read back from Images.
+	*
+	* @param renderResolution internal rendering resolution
+	* @param validationLayers validation layers to enable
+	* @param deviceExtensions device extensions to enable
+	* @param framesInFlight number of frames the host may record ahead of the GPU
+	* @param pipelineCachePath file the pipeline cache is loaded from and saved to. Empty to keep the cache in memory only
+	*/
+	VulkanCore(const VkExtent2D & renderResolution, const std::vector<const char*>& validationLayers, const std::vector<const char*>& deviceExtensions, uint32_t framesInFlight = 2, const std::string& pipelineCachePath = "pipeline_cache.bin");
 
 	~VulkanCore();
 
@@ -34,10 +155,15 @@ public:
 	VkPhysicalDevice getPhysicalDevice();
 
 	/**
-	* @return surface object handle
+	* @return surface object handle. VK_NULL_HANDLE when headless
 	*/
 	VkSurfaceKHR getSurface();
 
+	/**
+	* @return whether this VulkanCore runs without a window
+	*/
+	bool isHeadless() const;
+
 	/**
 	* @return index of graphics queue family
 	*/
@@ -59,12 +185,55 @@ public:
 	VkQueue getPresentQueue();
 
 	/**
-	* @return whether the engine is currently running
+	* @return whether the device has a compute-only queue family, so ASYNC_COMPUTE work executes alongside GRAPHICS work
+	*/
+	bool hasAsyncCompute() const;
+
+	/**
+	* @return whether the device has a transfer-only queue family, so uploads don't take time on GRAPHICS
+	*/
+	bool hasTransferQueue() const;
+
+	/**
+	* @return whether all of the device local memory is host visible, as with resizable BAR or unified memory, so the host can write GPU_PREFERRED Resources directly
+	*/
+	bool hasHostVisibleDeviceMemory() const;
+
+	/**
+	* @param queue queue to look up
+	* @return queue object work submitted to queue executes on
+	*/
+	VkQueue getQueue(QUEUE queue);
+
+	/**
+	* @param queue queue to look up
+	* @return index of the queue family of queue
+	*/
+	uint32_t getQueueFamilyIndex(QUEUE queue);
+
+	/**
+	* @brief Returns the queue families resources are shared between. Resources are created with concurrent sharing when there are several, so they need no ownership transfers.
+	*
+	* @return unique queue family indices
+	*/
+	std::vector<uint32_t> getResourceQueueFamilyIndices();
+
+	/**
+	* @brief Returns the BufferArena handing out slices to Buffers with the same usage and placement. Created on first use and destroyed with this VulkanCore.
+	*
+	* @param usage usage of the Buffers
+	* @param allocationInfo placement of the Buffers
+	* @return arena for the usage class
+	*/
+	BufferArena& getBufferArena(VkBufferUsageFlags usage, const VmaAllocationCreateInfo& allocationInfo);
+
+	/**
+	* @return whether the engine is currently running. Always true when headless
 	*/
 	bool engineRunning();
 
 	/**
-	* @return window dimensions
+	* @return window dimensions. The render resolution when headless
 	*/
 	VkExtent2D getWindowResolution();
 
@@ -79,7 +248,7 @@ public:
 	VmaAllocator getVmaAllocator();
 
 	/**
-	* @brief Creates a descriptor pool.
+	* @brief Creates a descriptor pool with room for one descriptor set per pass per frame slot.
 	*
 	* @param descriptorsUsed descriptors that will be used while the engine runs
 	* @param numPasses number of passes that will execute while the engine runs
@@ -93,31 +262,153 @@ public:
 	static std::unordered_map<AccessSpecifier::OPERATION, VkDescriptorType> descriptorTypes;
 
 	/**
-	* @brief Submits a command buffer for GPU execution.
+	* @brief Submits several batches of command buffers to a queue in a single submission.
 	*
-	* @param commandBuffer commands to submit
-	* @param signalFence fence to signal once commands complete
+	* The submission signals the timeline semaphore of the queue with a new submission value once all batches complete. Submission values increase across all queues.
+	*
+	* @param batches command buffers and semaphores to submit, in order
+	* @param queue queue to submit to
+	*
+	* @return submission value signaled once all batches complete
 	*/
-	void submitCommandBuffer(VkCommandBuffer& commandBuffer, VkFence signalFence);
+	uint64_t submitCommandBuffers(const std::vector<SubmitBatch>& batches, QUEUE queue = QUEUE::GRAPHICS);
 
 	/**
-	* @brief Returns underlying Vulkan command pool object.
+	* @brief Blocks until the submission identified by submissionValue and every earlier submission, to any queue, complete. Returns immediately if they already have.
 	*
+	* @param submissionValue value returned by submitCommandBuffers
+	*/
+	void waitForSubmission(uint64_t submissionValue);
+
+	/**
+	* @brief Returns the value of the most recent submission known to have completed along with every earlier submission.
+	*
+	* @return completed submission value
+	*/
+	uint64_t getCompletedSubmission();
+
+	/**
+	* @brief Returns the command pool of a thread pool worker for a frame slot. Only that worker may use the pool while the thread pool is running.
+	*
+	* Command buffers from these pools may be reset individually.
+	*
+	* @param threadIndex index of the worker in the thread pool
+	* @param frameSlot frame slot the command buffers are submitted in
+	* @param queue queue the command buffers are submitted to
 	* @return handle to Vulkan command pool object
 	*/
-	VkCommandPool getCommandPool();
+	VkCommandPool getCommandPool(uint32_t threadIndex, uint32_t frameSlot, QUEUE queue = QUEUE::GRAPHICS);
 
 	/**
-	* @brief Executes commands and blocks until they finish.
+	* @brief Executes commands on the graphics queue and blocks until they finish. The commands wait for all earlier submissions to other queues. Must not be called from several threads at once.
 	*
 	* @param commands commands to send to GPU
 	*/
 	void executeInstantCommands(std::function<void(VkCommandBuffer)> commands);
 
+	/**
+	* @brief Records commands filling resources for the TRANSFER queue without waiting for them to complete. Later submissions to other queues wait for them at their uploadWaitStages, so passes see the uploaded content.
+	*
+	* Uploads recorded one after another share a command buffer, which is submitted by flushUploads, right before any other submission or when a wait needs it. Uploads are ordered after earlier uploads, and after submissions to other queues only up to waitSubmission. Must be called from the thread submitting frames.
+	*
+	* @param commands commands to send to GPU
+	* @param onComplete called once the commands have completed, e.g. to free staging memory. Called by a later upload or on destruction
+	* @param waitSubmission most recent submission using the resources the commands write, which they wait for. 0 if none
+	* @return submission value the upload will be submitted with
+	*/
+	uint64_t executeUploadCommands(std::function<void(VkCommandBuffer)> commands, std::function<void()> onComplete = nullptr, uint64_t waitSubmission = 0);
+
+	/**
+	* @brief Submits the uploads recorded since the last submission in one batch. Does nothing if there are none.
+	*/
+	void flushUploads();
+
+	/**
+	* @brief Copies data into the persistently mapped staging ring buffer for the next executeUploadCommands call to copy from. The space is reused once that upload has completed.
+	*
+	* Only waits if the ring buffer is full of data of uploads still in flight.
+	*
+	* @param size size of data in bytes
+	* @param data data to stage
+	* @param region set to where data was staged
+	* @param alignment alignment the copy requires of region.offset, e.g. the texel size of an image format. Staged data is always aligned to 16 bytes on top
+	* @return false if size exceeds the capacity of the ring buffer, in which case nothing is staged
+	*/
+	bool stageUploadData(VkDeviceSize size, const void* data, StagingRegion& region, VkDeviceSize alignment = 1);
+
+	/**
+	* @brief Like stageUploadData, but lets write fill the staged bytes, e.g. to gather data from several places without an intermediate copy.
+	*
+	* @param size size of data in bytes
+	* @param write called with the mapped destination of size bytes
+	* @param region set to where data was staged
+	* @param alignment alignment the copy requires of region.offset
+	* @return false if size exceeds the capacity of the ring buffer, in which case nothing is staged
+	*/
+	bool stageUploadData(VkDeviceSize size, const std::function<void(void*)>& write, StagingRegion& region, VkDeviceSize alignment = 1);
+
 	const VkExtent2D& getRenderResolution() const;
 
+	/**
+	* @brief Returns the number of frames that may be in flight at once. Per-frame objects are duplicated this many times.
+	*
+	* @return number of frame slots
+	*/
+	uint32_t getFramesInFlight() const;
+
+	/**
+	* @brief Returns the frame slot of the frame the host is currently preparing.
+	*
+	* @return index in [0, getFramesInFlight())
+	*/
+	uint32_t getFrameSlot() const;
+
+	/**
+	* @brief Moves on to the next frame slot. Called once a frame has been submitted.
+	*/
+	void advanceFrameSlot();
+
+	/**
+	* @brief Returns the pipeline cache shared by all pipelines.
+	*
+	* @return handle to Vulkan pipeline cache object
+	*/
+	VkPipelineCache getPipelineCache();
+
+	/**
+	* @brief Returns the thread pool used for parallel work such as pipeline creation.
+	*
+	* @return thread pool
+	*/
+	ThreadPool& getThreadPool();
+
+	/**
+	* @brief Creates a graphics pipeline using the shared pipeline cache and records cache statistics. Safe to call from several threads at once.
+	*
+	* @param createInfo description of the pipeline
+	* @param pipeline variable to store the pipeline in
+	*/
+	void createGraphicsPipeline(const VkGraphicsPipelineCreateInfo& createInfo, VkPipeline& pipeline);
+
+	/**
+	* @brief Creates a compute pipeline using the shared pipeline cache and records cache statistics. Safe to call from several threads at once.
+	*
+	* @param createInfo description of the pipeline
+	* @param pipeline variable to store the pipeline in
+	*/
+	void createComputePipeline(const VkComputePipelineCreateInfo& createInfo, VkPipeline& pipeline);
+
+	/**
+	* @brief Returns cache hit and miss counts and timings of all pipelines created so far.
+	*
+	* @return pipeline cache statistics
+	*/
+	const PipelineCacheStatistics& getPipelineCacheStatistics() const;
+
 private:
 
+	VulkanCore(const VkExtent2D & renderResolution, const VkExtent2D & presentResolution, const std::string & windowName, const std::vector<const char*>& validationLayers, const std::vector<const char*>& deviceExtensions, uint32_t framesInFlight, const std::string& pipelineCachePath, bool headless);
+
 	static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
 		VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
 		VkDebugUtilsMessageTypeFlagsEXT messageType,
@@ -137,6 +428,8 @@ private:
 
 	void initVmaAllocator();
 
+	bool hostVisibleDeviceMemory = false;
+
 	bool checkDeviceExtensionSupport(VkPhysicalDevice device);
 
 	std::vector<const char*> getRequiredExtensions();
@@ -163,11 +456,29 @@ private:
 	VkQueue graphicsQueue;
 	VkQueue presentQueue;
 
-	GLFWwindow* window;
+	// compute-only queue family. Empty if the device has none
+	std::optional<uint32_t> computeQueueFamilyIndex;
+	VkQueue computeQueue = VK_NULL_HANDLE;
 
-	VkSurfaceKHR surface;
+	// transfer-only queue family. Empty if the device has none
+	std::optional<uint32_t> transferQueueFamilyIndex;
+	VkQueue transferQueue = VK_NULL_HANDLE;
 
-	VkPhysicalDevice physicalDevice;
+	/**
+	* @brief Maps queue to the queue work submitted to it executes on, which is GRAPHICS if the device has no compute-only queue family.
+	*/
+	QUEUE resolveQueue(QUEUE queue) const;
+
+	/**
+	* @brief number of values of QUEUE. Per-queue objects of queues the device lacks are left null
+	*/
+	static constexpr uint32_t QUEUE_COUNT = 3;
+
+	GLFWwindow* window = nullptr;
+
+	VkSurfaceKHR surface = VK_NULL_HANDLE;
+
+	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
 	VkDevice device;
 
 	VmaAllocator vmaAllocator;
@@ -178,14 +489,146 @@ private:
 
 	VkDebugUtilsMessengerEXT debugMessenger;
 
-	VkCommandPool commandPool;
+	// pass command pools, one per queue, thread pool worker and frame slot. Indexed by (queue * numThreads + threadIndex) * framesInFlight + frameSlot
+	std::vector<VkCommandPool> commandPools;
+
+	// separate from commandPools because it's reset on every use, which would also reset pass command buffers
+	VkCommandPool instantCommandPool;
 
 	VkCommandBuffer instantBuffer;
-	VkFence instantBufferReady;
+
+	// a batch of uploads in flight, along with what to release once it completes
+	struct PendingUpload
+	{
+		VkCommandBuffer commandBuffer;
+		uint64_t submissionValue;
+		std::vector<std::function<void()>> onComplete;
+	};
+
+	// allocates the command buffers of uploads. Belongs to the family of the TRANSFER queue
+	VkCommandPool uploadCommandPool;
+
+	// uploads in flight, oldest first
+	std::deque<PendingUpload> pendingUploads;
+
+	// command buffer uploads are recorded into until flushUploads submits it. VK_NULL_HANDLE if no upload has been recorded since
+	VkCommandBuffer openUploadCommandBuffer = VK_NULL_HANDLE;
+
+	// onComplete functions of the uploads recorded into openUploadCommandBuffer
+	std::vector<std::function<void()>> openUploadCallbacks;
+
+	// submission value of the most recent upload
+	uint64_t latestUploadSubmission = 0;
+
+	// most recent submission the uploads recorded into openUploadCommandBuffer wait for
+	uint64_t openUploadWaitSubmission = 0;
+
+	/**
+	* @brief Frees the command buffers of completed uploads and calls their onComplete.
+	*/
+	void reclaimUploads();
+
+	// a range of the staging ring buffer holding data of one upload
+	struct StagingRange
+	{
+		VkDeviceSize offset;
+		VkDeviceSize size;
+
+		// submission of the upload copying from the range. 0 until it is submitted
+		uint64_t submissionValue;
+	};
+
+	/**
+	* @brief capacity of the staging ring buffer in bytes. Larger uploads need staging memory of their own
+	*/
+	static constexpr VkDeviceSize STAGING_BUFFER_SIZE = 32 * 1024 * 1024;
+
+	/**
+	* @brief minimum alignment of staged data. Copies to images ask for the alignment of their format on top
+	*/
+	static constexpr VkDeviceSize STAGING_ALIGNMENT = 16;
+
+	VkBuffer stagingBuffer = VK_NULL_HANDLE;
+	VmaAllocation stagingAllocation = VK_NULL_HANDLE;
+
+	// mapped for the lifetime of stagingBuffer
+	uint8_t* stagingData = nullptr;
+
+	// ranges in use, in allocation order. The ring wraps around to offset 0 when the end has no room left
+	std::deque<StagingRange> stagingRanges;
+
+	void createStagingBuffer();
+
+	// arenas by usage and the VMA placement parameters of their blocks
+	std::map<std::tuple<VkBufferUsageFlags, VmaAllocationCreateFlags, VmaMemoryUsage, VkMemoryPropertyFlags>, std::unique_ptr<BufferArena>> bufferArenas;
+
+	/**
+	* @brief Finds room for size bytes after the most recently staged data without overwriting ranges in use.
+	*
+	* @param size bytes to fit
+	* @param alignment alignment of the room's offset
+	* @param offset set to the offset of the room
+	* @return whether there is room
+	*/
+	bool findStagingRoom(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset) const;
 
 	void createCommandPool();
 	void setupInstantCommands();
 
+	/**
+	* @brief timeline semaphores, one per queue, each signaled with submissionValue by every submission to its queue
+	*/
+	std::vector<VkSemaphore> timelineSemaphores;
+
+	/**
+	* @brief values of the submissions to each queue not yet known to have completed, oldest first
+	*/
+	std::vector<std::deque<uint64_t>> pendingSubmissions;
+
+	/**
+	* @brief value signaled by the most recent submission
+	*/
+	uint64_t submissionValue = 0;
+
+	/**
+	* @brief cached result of the most recent query of timelineSemaphores
+	*/
+	uint64_t completedSubmissionValue = 0;
+
+	void createTimelineSemaphores();
+
+	/**
+	* @brief pipeline cache used by every pipeline creation
+	*/
+	VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+
+	/**
+	* @brief whether VK_EXT_pipeline_creation_feedback is enabled
+	*/
+	bool pipelineCreationFeedbackEnabled = false;
+
+	PipelineCacheStatistics pipelineCacheStatistics;
+
+	// pipelines may be created from several threads
+	std::mutex pipelineCacheStatisticsMutex;
+
+	void createPipelineCache();
+
+	/**
+	* @brief Writes the pipeline cache to pipelineCachePath. Writes to a temporary file first so an interrupted write never leaves a truncated cache behind.
+	*/
+	void savePipelineCache();
+
+	/**
+	* @brief Checks whether serialized pipeline cache data was created by the current device and driver.
+	*
+	* @param data pipeline cache data
+	* @return whether data may be used to initialize a pipeline cache
+	*/
+	bool isPipelineCacheCompatible(const std::vector<char>& data);
+
+	void recordPipelineCreation(const VkPipelineCreationFeedbackEXT& feedback, std::chrono::steady_clock::duration creationTime);
+
 	/**
 	* @brief interal rendering resolution
 	*/
@@ -201,6 +644,31 @@ private:
 	*/
 	const std::string windowName;
 
+	/**
+	* @brief whether this VulkanCore runs without a window, surface and swap chain
+	*/
+	const bool headless;
+
+	/**
+	* @brief number of frame slots
+	*/
+	const uint32_t framesInFlight;
+
+	/**
+	* @brief frame slot of the frame the host is currently preparing
+	*/
+	uint32_t frameSlot = 0;
+
+	/**
+	* @brief file the pipeline cache is persisted to. Empty if it isn't persisted
+	*/
+	const std::string pipelineCachePath;
+
+	/**
+	* @brief worker threads, one per hardware thread
+	*/
+	ThreadPool threadPool{ std::max(1u, std::thread::hardware_concurrency()) };
+
 	/**
 	* @brief whether validations layers are enabled
 	*/
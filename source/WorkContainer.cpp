@@ -3,6 +3,8 @@
 #include "PassDependencyManager.h"
 #include "Timer.h"
 
+#include <unordered_set>
+
 std::vector<Pass*> dependencyListToVector(const std::vector<DependencyList>& dependencyLists)
 {
 	std::vector<Pass*> result;
@@ -17,23 +19,68 @@ std::vector<Pass*> dependencyListToVector(const std::vector<DependencyList>& dep
 
 void WorkContainer::init(std::vector<DependencyList> passDependencies, std::vector<Resource*>& resources, Image& presentImage)
 {
-	presentationController = std::make_unique<decltype(presentationController)::element_type>(vulkanCoreSupport, presentImage);
+	presentedImage = &presentImage;
 
+	for (const DependencyList& dependencyList : passDependencies)
+	{
+		std::vector<ResourceAccessSpecifier> accesses;
+		dependencyList.pass->getResources(accesses);
+		for (const ResourceAccessSpecifier& access : accesses)
+		{
+			if (access.resource == presentedImage)
+			{
+				presentedImageFinalAccess = access.accessSpecifier;
+			}
+		}
+	}
+
+	if (presentedImageFinalAccess.operation == AccessSpecifier::OPERATION::NO_OPERATION)
+	{
+		throw std::runtime_error("presented image is not accessed by any pass");
+	}
+
+	if (vulkanCoreSupport.isHeadless())
+	{
+		// there's no swap chain to present to. Keep the image readable by the host instead
+		presentImage.registerResourceUse({ AccessSpecifier::OPERATION::TRANSFER_SOURCE, AccessSpecifier::STAGE::TRANSFER });
+	}
+	else
+	{
+		presentationController = std::make_unique<decltype(presentationController)::element_type>(vulkanCoreSupport, presentImage, presentedImageFinalAccess);
+	}
+
+	std::vector<Resource*> initializedResources;
 	for (const auto& resource : resources)
+	{
+		if (culledResources.count(resource) == 0)
+		{
+			initializedResources.push_back(resource);
+		}
+	}
+
+	// host-side work such as decoding textures doesn't depend on other resources
+	vulkanCoreSupport.getThreadPool().parallelFor(initializedResources.size(), [&initializedResources](size_t index, uint32_t threadIndex)
+	{
+		initializedResources.at(index)->load();
+	});
+
+	for (Resource* resource : initializedResources)
 	{
 		resource->initialize();
 	}
 
-	Pass* finalUserPass = passDependencies.at(passDependencies.size() - 1).pass;
+	// transient Images get their memory once it's known which passes use them
+	transientImageAllocator = std::make_unique<TransientImageAllocator>(vulkanCoreSupport, dependencyListToVector(passDependencies), presentedImage);
 
+	// present passes are registered separately since only one of them executes per frame
 	std::vector<Pass*> presentPasses;
-	presentationController->getPasses(presentPasses);
-	for (const auto& pass : presentPasses)
+	if (presentationController)
 	{
-		passDependencies.push_back(DependencyList{ pass, { finalUserPass } });
+		presentationController->getPasses(presentPasses);
 	}
 
 	auto passes = dependencyListToVector(passDependencies);
+	passes.insert(passes.end(), presentPasses.begin(), presentPasses.end());
 	std::vector<VkDescriptorType> descriptorTypes;
 	for (Pass* const & pass : passes)
 	{
@@ -45,20 +92,49 @@ void WorkContainer::init(std::vector<DependencyList> passDependencies, std::vect
 
 			if (VulkanCore::descriptorTypes.count(operation) > 0) // An operation is a descriptor if it exists in descriptorTypes
 			{
-				descriptorTypes.push_back(VulkanCore::descriptorTypes[operation]);
+				descriptorTypes.push_back(resourceAccessSpecifier.resource->getDescriptorType(operation));
 			}
 		}
 	}
 
 	vulkanCoreSupport.createDescriptorPool(descriptorTypes, static_cast<int>(passes.size()));
 
-	PassDependencyManager::registerPasses(passDependencies);
+	// every pass is submitted with the frame, so every resource they use is in use until the frame completes
+	std::unordered_set<Resource*> uniqueResources;
+	for (Pass* const& pass : passes)
+	{
+		std::vector<ResourceAccessSpecifier> accesses;
+		pass->getResources(accesses);
+		for (const ResourceAccessSpecifier& access : accesses)
+		{
+			uniqueResources.insert(access.resource);
+		}
+	}
+	frameResources.assign(uniqueResources.begin(), uniqueResources.end());
+
+	std::vector<Resource*> outputs = exportedResources;
+	outputs.push_back(presentedImage);
+
+	// submits the initial uploads of all resources together with the transitions to the states frames start in
+	PassDependencyManager::registerPasses(vulkanCoreSupport, passDependencies, presentPasses, outputs);
+
+	// any present pass may execute, so their batch waits wherever one of them depends on another queue
+	for (Pass* presentPass : presentPasses)
+	{
+		presentWaitStages |= PassDependencyManager::getCrossQueueWaitStages(presentPass);
+		presentUploadWaitStages |= PassDependencyManager::getUploadWaitStages(presentPass);
+	}
 }
 
 
 
-WorkContainer::WorkContainer(VulkanCore& vulkanCoreSupport) : vulkanCoreSupport(vulkanCoreSupport), initialized(false)
+WorkContainer::WorkContainer(VulkanCore& vulkanCoreSupport) : vulkanCoreSupport(vulkanCoreSupport), initialized(false), frameSlotSubmissions(vulkanCoreSupport.getFramesInFlight(), 0)
+{
+}
+
+WorkContainer::~WorkContainer()
 {
+	vulkanCoreSupport.waitForSubmission(previousFrameSubmission);
 }
 
 void WorkContainer::run(std::vector<DependencyList>& passDependencies, std::vector<Resource*>& resources, Image& presentImage)
@@ -69,10 +145,163 @@ void WorkContainer::run(std::vector<DependencyList>& passDependencies, std::vect
 		initialized = true;
 	}
 
+	uint32_t frameSlot = vulkanCoreSupport.getFrameSlot();
+
+	// command buffers and descriptor sets of this slot were last used framesInFlight frames ago. Only that frame must complete
+	vulkanCoreSupport.waitForSubmission(frameSlotSubmissions.at(frameSlot));
+
+	for (Resource* resource : frameResources)
+	{
+		resource->prepareForFrame(frameSlot);
+	}
+
+	// consecutive passes on the same queue go in one submission, made once the queue changes. A batch waits for the other queue only at the stages its passes depend on it, so e.g. a frame's draws overlap the previous frame's async compute until they reach a resource it uses
+	std::vector<SubmitBatch> batches;
+	VulkanCore::QUEUE batchQueue = VulkanCore::QUEUE::GRAPHICS;
+
+	auto beginBatch = [&](VulkanCore::QUEUE queue, const SubmitBatch& batch)
+	{
+		if (!batches.empty() && queue != batchQueue)
+		{
+			vulkanCoreSupport.submitCommandBuffers(batches, batchQueue);
+			batches.clear();
+		}
+
+		batchQueue = queue;
+		batches.push_back(batch);
+	};
+
 	for (const auto& dependency : passDependencies)
 	{
-		dependency.pass->execute();
+		Pass* pass = dependency.pass;
+		if (pass->getRecordingPass() != pass)
+		{
+			continue;
+		}
+
+		if (batches.empty() || pass->getQueue() != batchQueue)
+		{
+			// the passes add the stages at which they access uploaded resources
+			SubmitBatch batch{};
+			batch.uploadWaitStages = 0;
+			beginBatch(pass->getQueue(), batch);
+		}
+
+		// the frame that last submitted this slot has completed, so its command buffer may be re-recorded
+		pass->updateCommandBuffer(frameSlot);
+		batches.back().commandBuffers.push_back(pass->getCommandBuffer(frameSlot));
+		batches.back().crossQueueWaitStages |= PassDependencyManager::getCrossQueueWaitStages(pass);
+		batches.back().uploadWaitStages |= PassDependencyManager::getUploadWaitStages(pass);
+	}
+
+	// presentation goes in a batch of its own so only the blit waits for the swap chain image
+	SubmitBatch presentBatch{};
+	bool presenting = presentationController && presentationController->acquire(presentBatch);
+	if (presenting)
+	{
+		presentBatch.crossQueueWaitStages = presentWaitStages;
+		presentBatch.uploadWaitStages = presentUploadWaitStages;
+		beginBatch(VulkanCore::QUEUE::GRAPHICS, presentBatch);
+	}
+
+	previousFrameSubmission = vulkanCoreSupport.submitCommandBuffers(batches, batchQueue);
+	frameSlotSubmissions.at(frameSlot) = previousFrameSubmission;
+
+	for (Resource* resource : frameResources)
+	{
+		resource->registerSubmission(previousFrameSubmission, frameSlot);
+	}
+
+	if (presenting)
+	{
+		presentationController->present();
+	}
+
+	vulkanCoreSupport.advanceFrameSlot();
+}
+
+void WorkContainer::run(const std::vector<Pass*>& passes, std::vector<Resource*>& resources, Image& presentImage)
+{
+	if (!renderGraph)
+	{
+		std::vector<Resource*> outputs = exportedResources;
+		outputs.push_back(&presentImage);
+
+		renderGraph = std::make_unique<RenderGraph>(passes, outputs);
+		compiledDependencies = renderGraph->getSchedule();
+
+		for (Pass* pass : renderGraph->getCulledPasses())
+		{
+			std::vector<ResourceAccessSpecifier> accesses;
+			pass->getResources(accesses);
+			for (const ResourceAccessSpecifier& access : accesses)
+			{
+				culledResources.insert(access.resource);
+			}
+		}
+
+		for (const DependencyList& dependencyList : compiledDependencies)
+		{
+			std::vector<ResourceAccessSpecifier> accesses;
+			dependencyList.pass->getResources(accesses);
+			for (const ResourceAccessSpecifier& access : accesses)
+			{
+				culledResources.erase(access.resource);
+			}
+		}
+	}
+
+	run(compiledDependencies, resources, presentImage);
+}
+
+void WorkContainer::exportResource(Resource& resource)
+{
+	if (initialized)
+	{
+		throw std::runtime_error("resources must be exported before the first run");
+	}
+
+	exportedResources.push_back(&resource);
+}
+
+std::vector<Pass*> WorkContainer::getCulledPasses() const
+{
+	if (!renderGraph)
+	{
+		return {};
+	}
+
+	return renderGraph->getCulledPasses();
+}
+
+std::vector<Pass*> WorkContainer::getScheduledPasses() const
+{
+	std::vector<Pass*> scheduledPasses;
+	for (const DependencyList& dependencyList : compiledDependencies)
+	{
+		scheduledPasses.push_back(dependencyList.pass);
+	}
+
+	return scheduledPasses;
+}
+
+const BarrierStatistics& WorkContainer::getBarrierStatistics() const
+{
+	return PassDependencyManager::getBarrierStatistics();
+}
+
+const TransientImageAllocator& WorkContainer::getTransientImageAllocator() const
+{
+	return *transientImageAllocator;
+}
+
+void WorkContainer::readPresentedImage(const Buffer& destination)
+{
+	if (!initialized)
+	{
+		throw std::runtime_error("no image has been rendered");
 	}
 
-	presentationController->present();
+	// the copy is submitted after every pass, and its barrier waits for the final access to the image
+	presentedImage->copyImageToBuffer(destination, presentedImageFinalAccess);
 }
@@ -1,7 +1,10 @@
 #pragma once
 #include "PresentationController.h"
 #include "PassDependencyManager.h"
+#include "RenderGraph.h"
+#include "TransientImageAllocator.h"
 #include "memory"
+#include <unordered_set>
 
 class WorkContainer
 {
@@ -10,19 +13,118 @@ private:
 
 	VulkanCore& vulkanCoreSupport;
 	
+	// null when vulkanCoreSupport is headless
 	std::unique_ptr<PresentationController> presentationController;
 
 	bool initialized;
 
+	// submission value of the previous frame
+	uint64_t previousFrameSubmission = 0;
+
+	// submission value of the most recent frame in each frame slot
+	std::vector<uint64_t> frameSlotSubmissions;
+
+	// every resource used by a pass, including presentation passes
+	std::vector<Resource*> frameResources;
+
+	// compiled from the passes given to run. Null if dependencies are supplied directly
+	std::unique_ptr<RenderGraph> renderGraph;
+
+	// schedule of renderGraph
+	std::vector<DependencyList> compiledDependencies;
+
+	// resources used only by passes renderGraph culled. They're left uninitialized
+	std::unordered_set<Resource*> culledResources;
+
+	// resources read outside the passes. Passes writing them aren't culled
+	std::vector<Resource*> exportedResources;
+
+	// memory shared by transient Images
+	std::unique_ptr<TransientImageAllocator> transientImageAllocator;
+
+	Image* presentedImage = nullptr;
+
+	// stages at which the presentation batch waits for other queues
+	VkPipelineStageFlags presentWaitStages = 0;
+
+	// stages at which the presentation batch waits for pending uploads
+	VkPipelineStageFlags presentUploadWaitStages = 0;
+
+	// how the final pass to touch presentedImage accesses it. Describes the layout presentedImage is left in after a frame
+	AccessSpecifier presentedImageFinalAccess{ AccessSpecifier::OPERATION::NO_OPERATION, AccessSpecifier::STAGE::INITIAL };
+
 	void init(std::vector<DependencyList> passDependencies, std::vector<Resource*>& resources, Image& presentImage);
 
 public:
 	WorkContainer(VulkanCore& vulkanCoreSupport);
+	~WorkContainer();
 	WorkContainer(const WorkContainer&) = delete;
 	WorkContainer(WorkContainer&&) = delete;
 
 	WorkContainer& operator=(const WorkContainer&) = delete;
 	WorkContainer& operator=(WorkContainer&&) = delete;
 
+	/**
+	* @brief Executes one frame of passes whose dependencies are specified by hand.
+	*
+	* @param passDependencies passes in execution order along with the passes each depends on
+	* @param resources every resource used by the passes
+	* @param presentImage image to present at the end of the frame
+	*/
 	void run(std::vector<DependencyList>& passDependencies, std::vector<Resource*>& resources, Image& presentImage);
+
+	/**
+	* @brief Executes one frame of passes, deriving their dependencies and execution order from the resources they access.
+	*
+	* The passes are compiled into a RenderGraph on the first call. Later calls must supply the same passes. Passes contributing to neither presentImage nor an exported resource are culled, and resources only they use aren't initialized.
+	*
+	* @param passes passes in declaration order
+	* @param resources every resource used by the passes
+	* @param presentImage image to present at the end of the frame
+	*/
+	void run(const std::vector<Pass*>& passes, std::vector<Resource*>& resources, Image& presentImage);
+
+	/**
+	* @brief Marks resource as used outside the passes, e.g. read back by the host, so passes writing it aren't culled. Must be called before the first run.
+	*
+	* @param resource resource to keep
+	*/
+	void exportResource(Resource& resource);
+
+	/**
+	* @brief Returns the passes culled because they contribute to neither the presented image nor an exported resource. Only valid after run has been called at least once.
+	*
+	* @return culled passes. Empty if dependencies are specified by hand
+	*/
+	std::vector<Pass*> getCulledPasses() const;
+
+	/**
+	* @brief Returns the passes scheduled for execution, leaving out culled passes and ClearPasses fused into a DrawPass. Passes merged into the render pass of another are included, see Pass::getRecordingPass. Only valid after run has been called at least once.
+	*
+	* @return scheduled passes in execution order. Empty if dependencies are specified by hand
+	*/
+	std::vector<Pass*> getScheduledPasses() const;
+
+	/**
+	* @brief Copies the Image passed to run into a host-visible Buffer, blocking until the copy completes.
+	* 
+	* Intended for headless use. Only valid after run has been called at least once.
+	* 
+	* @param destination CPU_PREFERRED TRANSFER_DESTINATION Buffer large enough to hold the Image
+	*/
+	void readPresentedImage(const Buffer& destination);
+
+	/**
+	* @brief Returns how many barriers the passes record per frame and how many were found redundant. Only valid after run has been called at least once.
+	*
+	* @return barrier statistics
+	*/
+	const BarrierStatistics& getBarrierStatistics() const;
+
+	/**
+	* @brief Returns the owner of the memory shared by transient Images. Only valid after run has been called at least once.
+	*
+	* @return transient Image allocator
+	*/
+	const TransientImageAllocator& getTransientImageAllocator() const;
 };
\ No newline at end of file
@@ -1,11 +1,16 @@
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tiny_obj_loader.h>
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
 
 #include "WorkContainer.h"
 #include "GeometryContainer.h"
 #include "DrawPass.h"
 #include "ComputePass.h"
 #include "ClearPass.h"
+#include "UniformAllocator.h"
 #include "Transform.h"
 #include "Timer.h"
 #include "InputSupport.h"
@@ -69,8 +74,23 @@ void readModel(std::string filename, std::vector<ExampleVertex>& vertices, std::
 	}
 }
 
-int main()
+int main(int argc, char** argv)
 {
+	// "--headless [frames]" renders a fixed number of frames without a window, e.g. to benchmark on machines without a display
+	const bool headless = argc > 1 && std::string(argv[1]) == "--headless";
+	int headlessFrameCount = 1000;
+	if (argc > 2)
+	{
+		char* end = nullptr;
+		long frames = std::strtol(argv[2], &end, 10);
+		if (*end != '\0' || frames <= 0 || frames > INT_MAX)
+		{
+			std::cerr << "usage: " << argv[0] << " [--headless [frames]]" << std::endl;
+			return EXIT_FAILURE;
+		}
+		headlessFrameCount = static_cast<int>(frames);
+	}
+
 	std::vector<ExampleVertex> vertices;
 	std::vector<uint32_t> indices;
 	readModel("Assets/Meshes/mon.obj", vertices, indices);
@@ -88,23 +108,28 @@ int main()
 		VK_KHR_SWAPCHAIN_EXTENSION_NAME
 	};
 
-	VulkanCore vulkanCore(resolution, resolution, "vt", validationLayers, deviceExtensions);
+	// render nodes usually don't ship the SDK layers, and nothing needs a swap chain
+	std::unique_ptr<VulkanCore> vulkanCorePointer = headless
+		? std::make_unique<VulkanCore>(resolution, std::vector<const char*>{}, std::vector<const char*>{})
+		: std::make_unique<VulkanCore>(resolution, resolution, "vt", validationLayers, deviceExtensions);
+	VulkanCore& vulkanCore = *vulkanCorePointer;
 
 	WorkContainer workContainer(vulkanCore);
 
 	auto mesh = GeometryContainer(vulkanCore, vertices, indices, VK_FRONT_FACE_COUNTER_CLOCKWISE);
-	auto ubo = Buffer(vulkanCore, sizeof(UBO), AccessSpecifier::OPERATION::UNIFORM_BUFFER, Resource::ACCESS_PROPERTY::CPU_PREFERRED);
-	auto rasterOutput = Image(vulkanCore, VK_FORMAT_R32G32B32A32_SFLOAT, resolution, Resource::ACCESS_PROPERTY::GPU_PREFERRED);
-	auto depthBuffer = Image(vulkanCore, VK_FORMAT_D32_SFLOAT, resolution, Resource::ACCESS_PROPERTY::GPU_PREFERRED);
-	auto velocityBuffer = Image(vulkanCore, VK_FORMAT_R32G32B32A32_SFLOAT, resolution, Resource::ACCESS_PROPERTY::GPU_PREFERRED);
-	auto finalOutput = Image(vulkanCore, VK_FORMAT_R32G32B32A32_SFLOAT, resolution, Resource::ACCESS_PROPERTY::GPU_PREFERRED);
+	auto uniforms = UniformAllocator(vulkanCore, sizeof(UBO), 1);
+	uint32_t uboBlock = uniforms.allocate();
+	auto rasterOutput = Image(vulkanCore, VK_FORMAT_R32G32B32A32_SFLOAT, resolution, Resource::ACCESS_PROPERTY::GPU_PREFERRED, Image::LIFETIME::TRANSIENT);
+	auto depthBuffer = Image(vulkanCore, VK_FORMAT_D32_SFLOAT, resolution, Resource::ACCESS_PROPERTY::GPU_PREFERRED, Image::LIFETIME::TRANSIENT);
+	auto velocityBuffer = Image(vulkanCore, VK_FORMAT_R32G32B32A32_SFLOAT, resolution, Resource::ACCESS_PROPERTY::GPU_PREFERRED, Image::LIFETIME::TRANSIENT);
+	auto finalOutput = Image(vulkanCore, VK_FORMAT_R32G32B32A32_SFLOAT, resolution, Resource::ACCESS_PROPERTY::GPU_PREFERRED, Image::LIFETIME::TRANSIENT);
 
 	std::vector<ResourceShaderInterface> resources =
 	{
 		ResourceShaderInterface{ResourceAccessSpecifier{&rasterOutput, {AccessSpecifier::OPERATION::COLOR_ATTACHMENT_OUTPUT, AccessSpecifier::STAGE::FRAGMENT_SHADER}}, -1, false},
 		ResourceShaderInterface{ResourceAccessSpecifier{&velocityBuffer, {AccessSpecifier::OPERATION::COLOR_ATTACHMENT_OUTPUT, AccessSpecifier::STAGE::FRAGMENT_SHADER}}, -1, false},
 		ResourceShaderInterface{ResourceAccessSpecifier{&depthBuffer, {AccessSpecifier::OPERATION::DEPTH_BUFFER, AccessSpecifier::STAGE::FRAGMENT_SHADER}}, -1, false},
-		ResourceShaderInterface{ResourceAccessSpecifier{&ubo, {AccessSpecifier::OPERATION::UNIFORM_BUFFER, AccessSpecifier::STAGE::VERTEX_SHADER}}, 0, false}
+		ResourceShaderInterface{ResourceAccessSpecifier{&uniforms, {AccessSpecifier::OPERATION::UNIFORM_BUFFER, AccessSpecifier::STAGE::VERTEX_SHADER}}, 0, false, uboBlock}
 	};
 
 	auto samplePass = DrawPass(vulkanCore, resources, "Assets/Shaders/motion.vert.spv", "Assets/Shaders/motion.frag.spv", mesh);
@@ -116,13 +141,16 @@ int main()
 		ResourceShaderInterface{ResourceAccessSpecifier{&finalOutput, {AccessSpecifier::OPERATION::SHADER_STORAGE_IMAGE, AccessSpecifier::STAGE::COMPUTE_SHADER}}, 2, false}
 	};
 
-	auto blendPass = ComputePass(vulkanCore, resources, "Assets/Shaders/motion.comp.spv");
+	// the blur strength is pushed rather than kept in a uniform buffer, since it rarely changes
+	std::vector<VkPushConstantRange> blurSettings = { VkPushConstantRange{ VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(float) } };
+
+	// the blur of one frame may run alongside the next frame's draw
+	auto blendPass = ComputePass(vulkanCore, resources, "Assets/Shaders/motion.comp.spv", VulkanCore::QUEUE::ASYNC_COMPUTE, blurSettings);
 
-	std::vector<Resource* >usedResources = { &mesh.getIndexBuffer(), &mesh.getVertexBuffer(), &velocityBuffer, &ubo, &rasterOutput, &finalOutput, &depthBuffer };
+	std::vector<Resource* >usedResources = { &mesh.getIndexBuffer(), &mesh.getVertexBuffer(), &velocityBuffer, &uniforms, &rasterOutput, &finalOutput, &depthBuffer };
 
-	std::vector<DependencyList> predecessors;
-	predecessors.push_back(DependencyList{ &samplePass, {} });
-	predecessors.push_back(DependencyList{ &blendPass, {&samplePass} });
+	// dependencies are derived from the declared resource accesses
+	std::vector<Pass*> passes = { &samplePass, &blendPass };
 
 	Transform objectTransform;
 
@@ -134,29 +162,102 @@ int main()
 
 	auto previousMVP = glm::mat4();
 
-	while (vulkanCore.engineRunning())
+	int frameCount = 0;
+
+	// the benchmark starts once the first frame has completed, so initialization isn't measured
+	std::chrono::steady_clock::time_point benchmarkStart;
+
+	while (headless ? frameCount < headlessFrameCount : vulkanCore.engineRunning())
 	{
 		// submit gpu commands
-		workContainer.run(predecessors, usedResources, finalOutput);
-		glfwPollEvents();
+		workContainer.run(passes, usedResources, finalOutput);
+
+		if (headless && frameCount == 0)
+		{
+			vkDeviceWaitIdle(vulkanCore.getDevice());
+			benchmarkStart = std::chrono::steady_clock::now();
+		}
 
 		// update scene
 		timer.update();
 		objectTransform.setPosition(glm::vec3(sin(timer.getCurrentTime() * 2.5f) * 3, 0, 0));
-		Behavior::FPSCameraMovement(camera, timer, 2, 1);
 
-		// update UBO
-		UBO tempUBO = {};
+		if (!headless)
+		{
+			glfwPollEvents();
+			Behavior::FPSCameraMovement(camera, timer, 2, 1);
+		}
+
+		// update UBO in place. The mapped memory may be write-combined, so it's only written, never read
 		glm::mat4x4 M, normalMat;
 		objectTransform.getM(M, normalMat);
-		tempUBO.previousMVP = previousMVP;
-		tempUBO.currentMVP = camera.getVP() * M;
-		tempUBO.normalMatrix = normalMat;
-		tempUBO.screenResolution.x = static_cast<float>(resolution.width);
-		tempUBO.screenResolution.y = static_cast<float>(resolution.height);
-		ubo.copyData(sizeof(tempUBO), &tempUBO);
-
-		previousMVP = tempUBO.currentMVP;
+		glm::mat4 currentMVP = camera.getVP() * M;
+
+		UBO* uboData = uniforms.mapped<UBO>(uboBlock);
+		if (uboData != nullptr)
+		{
+			uboData->previousMVP = previousMVP;
+			uboData->currentMVP = currentMVP;
+			uboData->normalMatrix = normalMat;
+			uboData->screenResolution = glm::vec4(static_cast<float>(resolution.width), static_cast<float>(resolution.height), 0, 0);
+			uniforms.flush(uboBlock);
+		}
+
+		previousMVP = currentMVP;
+
+		// the blur fades in over the first second. Once it stops changing, the command buffers are no longer re-recorded
+		float velocityScale = std::min(timer.getCurrentTime(), 1.0f);
+		blendPass.setPushConstants(0, sizeof(velocityScale), &velocityScale);
+
+		++frameCount;
+	}
+
+	if (headless)
+	{
+		// frames still in flight are part of the measurement
+		vkDeviceWaitIdle(vulkanCore.getDevice());
+		float benchmarkSeconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - benchmarkStart).count();
+		std::cout << frameCount - 1 << " frames in " << benchmarkSeconds << "s, excluding the first frame" << std::endl;
+
+		// a checksum of the last frame lets runs on different machines or builds be compared
+		VkDeviceSize imageSize = static_cast<VkDeviceSize>(resolution.width) * resolution.height * 4 * sizeof(float);
+		Buffer readback(vulkanCore, imageSize, AccessSpecifier::OPERATION::TRANSFER_DESTINATION, Resource::ACCESS_PROPERTY::CPU_PREFERRED);
+		readback.initialize();
+		workContainer.readPresentedImage(readback);
+
+		std::vector<uint8_t> pixels(static_cast<size_t>(imageSize));
+		readback.readData(imageSize, pixels.data());
+
+		uint64_t checksum = 14695981039346656037ull;
+		for (uint8_t byte : pixels)
+		{
+			checksum = (checksum ^ byte) * 1099511628211ull;
+		}
+		std::cout << "last frame checksum: " << std::hex << checksum << std::dec << std::endl;
+
+		const PipelineCacheStatistics& cacheStatistics = vulkanCore.getPipelineCacheStatistics();
+		std::cout << "pipeline cache: " << cacheStatistics.hits << " hits (" << cacheStatistics.hitMilliseconds << "ms), "
+			<< cacheStatistics.misses << " misses (" << cacheStatistics.missMilliseconds << "ms), "
+			<< cacheStatistics.unknown << " unknown (" << cacheStatistics.unknownMilliseconds << "ms)" << std::endl;
+
+		std::cout << "async compute: " << (vulkanCore.hasAsyncCompute() ? "dedicated queue" : "graphics queue")
+			<< ", uploads: " << (vulkanCore.hasTransferQueue() ? "dedicated queue" : "graphics queue")
+			<< (vulkanCore.hasHostVisibleDeviceMemory() ? ", direct writes to device memory" : "") << std::endl;
+
+		// merged passes are recorded into the command buffers of another, and fused passes aren't scheduled at all
+		std::vector<Pass*> scheduledPasses = workContainer.getScheduledPasses();
+		size_t executedPasses = std::count_if(scheduledPasses.begin(), scheduledPasses.end(), [](Pass* pass) { return pass->getRecordingPass() == pass; });
+		size_t culledPasses = workContainer.getCulledPasses().size();
+		std::cout << "passes: " << executedPasses << " executed, " << scheduledPasses.size() - executedPasses << " merged into subpasses, "
+			<< passes.size() - scheduledPasses.size() - culledPasses << " fused, " << culledPasses << " culled" << std::endl;
+
+		const BarrierStatistics& barrierStatistics = workContainer.getBarrierStatistics();
+		std::cout << "barriers: " << barrierStatistics.recorded << " recorded, " << barrierStatistics.elided << " elided" << std::endl;
+
+		const TransientImageAllocator& transientImages = workContainer.getTransientImageAllocator();
+		std::cout << "transient images: " << transientImages.getAllocatedBytes() / (1024 * 1024) << "MiB allocated for "
+			<< transientImages.getRequiredBytes() / (1024 * 1024) << "MiB of images, "
+			<< transientImages.getLazilyAllocatedBytes() / (1024 * 1024) << "MiB lazily" << std::endl;
 	}
 
 	return EXIT_SUCCESS;